@@ -0,0 +1,226 @@
+/*
+ * Copyright (c) 2026 The fs-utils authors.  All Rights Reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS
+ * OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+#include "fs-utils.h"
+
+#include <sys/stat.h>
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <rump/rump_syscalls.h>
+
+#include <fsu_utils.h>
+#include <fsu_mount.h>
+
+/*
+ * Times sequential reads of a file of the image with fsu_fread, for each
+ * size of request given.  Requests up to the size of the buffer of the
+ * stream are copied out of it, larger ones are read straight into the
+ * memory of the caller.  The file is made if it does not exist yet, and
+ * the best time of the rounds is printed.
+ */
+static const size_t rb_defsizes[] = {
+	4096, 65536, 1024 * 1024, 8 * 1024 * 1024
+};
+
+static uint64_t	rb_clock(void);
+static void	rb_make(const char *, uint64_t);
+static uint64_t	rb_read(const char *, char *, size_t, uint64_t *, size_t *);
+static uint64_t	rb_size(const char *);
+static void	usage(void);
+
+int
+main(int argc, char *argv[])
+{
+	struct stat sb;
+	const char *file;
+	char *buf;
+	size_t bufsize, maxsize, *sizes;
+	uint64_t best, fsize, nbytes, t;
+	int ch, i, j, nsizes, rounds;
+
+	setprogname(argv[0]);
+
+	if (fsu_mount(&argc, &argv, MOUNT_READWRITE) != 0)
+		usage();
+
+	fsize = 64 * 1024 * 1024;
+	rounds = 3;
+	while ((ch = getopt(argc, argv, "r:s:")) != -1) {
+		switch (ch) {
+		case 'r':
+			if ((rounds = atoi(optarg)) < 1)
+				errx(EXIT_FAILURE, "-r %s: invalid value",
+				    optarg);
+			break;
+		case 's':
+			fsize = rb_size(optarg);
+			break;
+		case '?':
+		default:
+			usage();
+			/* NOTREACHED */
+		}
+	}
+	argc -= optind;
+	argv += optind;
+
+	if (argc < 1)
+		usage();
+	file = argv[0];
+	argc--;
+	argv++;
+
+	nsizes = argc == 0 ?
+	    (int)(sizeof(rb_defsizes) / sizeof(rb_defsizes[0])) : argc;
+	if ((sizes = malloc(nsizes * sizeof(*sizes))) == NULL)
+		err(EXIT_FAILURE, NULL);
+	for (i = 0; i < nsizes; i++)
+		sizes[i] = argc == 0 ? rb_defsizes[i] : rb_size(argv[i]);
+
+	if (rump_sys_stat(file, &sb) == -1) {
+		if (errno != ENOENT)
+			err(EXIT_FAILURE, "%s", file);
+		rb_make(file, fsize);
+	}
+
+	for (maxsize = 0, i = 0; i < nsizes; i++)
+		if (sizes[i] > maxsize)
+			maxsize = sizes[i];
+	if ((buf = malloc(maxsize)) == NULL)
+		err(EXIT_FAILURE, NULL);
+
+	/* the first read brings the file into the cache of the kernel */
+	(void)rb_read(file, buf, maxsize, &nbytes, &bufsize);
+
+	printf("%10s %-8s %10s %10s\n", "request", "path", "MB/s", "ms");
+	for (i = 0; i < nsizes; i++) {
+		for (best = UINT64_MAX, j = 0; j < rounds; j++)
+			if ((t = rb_read(file, buf, sizes[i], &nbytes,
+			    &bufsize)) < best)
+				best = t;
+		printf("%10zu %-8s %10.1f %10.1f\n", sizes[i],
+		    sizes[i] > bufsize ? "direct" : "buffered",
+		    best == 0 ? 0 : nbytes * 1e3 / best, best / 1e6);
+	}
+
+	free(buf);
+	free(sizes);
+	return EXIT_SUCCESS;
+}
+
+static uint64_t
+rb_clock(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/* Reads the whole file with requests of size bytes, in nanoseconds. */
+static uint64_t
+rb_read(const char *path, char *buf, size_t size, uint64_t *nbytes,
+	size_t *bufsize)
+{
+	FSU_FILE *file;
+	uint64_t t0;
+	size_t n;
+
+	t0 = rb_clock();
+	if ((file = fsu_fopen(path, "r")) == NULL)
+		err(EXIT_FAILURE, "%s", path);
+	*nbytes = 0;
+	while ((n = fsu_fread(buf, 1, size, file)) > 0) {
+		*nbytes += n;
+		if (n < size)
+			break;
+	}
+	if (fsu_ferror(file))
+		errx(EXIT_FAILURE, "%s: read error", path);
+	*bufsize = file->fd_bufsize;
+	fsu_fclose(file);
+	return rb_clock() - t0;
+}
+
+static void
+rb_make(const char *path, uint64_t fsize)
+{
+	FSU_FILE *file;
+	char *buf;
+	size_t n;
+
+	if ((buf = malloc(1024 * 1024)) == NULL)
+		err(EXIT_FAILURE, NULL);
+	memset(buf, 'a', 1024 * 1024);
+
+	if ((file = fsu_fopen(path, "w")) == NULL)
+		err(EXIT_FAILURE, "%s", path);
+	for (; fsize > 0; fsize -= n) {
+		n = fsize < 1024 * 1024 ? fsize : 1024 * 1024;
+		if (fsu_fwrite(buf, 1, n, file) != n)
+			errx(EXIT_FAILURE, "%s: write error", path);
+	}
+	if (fsu_fflush(file) != 0)
+		err(EXIT_FAILURE, "%s", path);
+	fsu_fclose(file);
+	free(buf);
+}
+
+/* A number of bytes, k and m multiplying it by 1024 and 1024 * 1024. */
+static uint64_t
+rb_size(const char *s)
+{
+	unsigned long long n;
+	char *ep;
+
+	errno = 0;
+	n = strtoull(s, &ep, 10);
+	if (*ep == 'k' || *ep == 'K') {
+		n *= 1024;
+		ep++;
+	} else if (*ep == 'm' || *ep == 'M') {
+		n *= 1024 * 1024;
+		ep++;
+	}
+	if (errno != 0 || ep == s || *ep != '\0' || n == 0 || n > SIZE_MAX)
+		errx(EXIT_FAILURE, "%s: invalid size", s);
+	return n;
+}
+
+static void
+usage(void)
+{
+
+	fprintf(stderr, "usage: %s %s [-r rounds] [-s size] file [request "
+	    "...]\n", getprogname(), fsu_mount_usage());
+
+	exit(EXIT_FAILURE);
+}
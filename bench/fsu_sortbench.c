@@ -0,0 +1,283 @@
+/*
+ * Copyright (c) 2026 The fs-utils authors.  All Rights Reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS
+ * OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+#include "fs-utils.h"
+
+#include <sys/param.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <rump/rump_syscalls.h>
+
+#include <fsu_utils.h>
+#include <fsu_fts.h>
+#include <fsu_mount.h>
+#include <fsu_stats.h>
+
+#include "ls.h"
+#include "extern_ls.h"
+
+#ifndef __NetBSD__
+#include "fsu_compat.h"
+#endif
+
+/*
+ * Times walks of a large directory of the image sorted by the comparison
+ * functions of fsu_ls through qsort, then on the keys of
+ * fsu_fts_setsort, and checks that both give the same order.  The time
+ * of an unsorted walk is printed too, what is left of the others being
+ * the sort.  The directory is made if it does not exist yet, its files
+ * having random names, sizes and modification times.
+ */
+static const struct sb_key {
+	const char *sk_name;
+	int sk_key;
+	int (*sk_cmp)(const FTSENT *, const FTSENT *);
+} sb_keys[] = {
+	{ "name",	FTS_SORT_NAME,				namecmp },
+	{ "-name",	FTS_SORT_NAME | FTS_SORT_REVERSE,	revnamecmp },
+	{ "size",	FTS_SORT_SIZE,				sizecmp },
+	{ "-size",	FTS_SORT_SIZE | FTS_SORT_REVERSE,	revsizecmp },
+	{ "mtime",	FTS_SORT_MTIME,				modcmp },
+	{ "-mtime",	FTS_SORT_MTIME | FTS_SORT_REVERSE,	revmodcmp },
+};
+
+/* Names of the entries in the order of a walk */
+struct sb_names {
+	char **sn_names;
+	size_t sn_count;
+	size_t sn_size;
+};
+
+static int (*sb_fn)(const FTSENT *, const FTSENT *);
+
+static int	sb_cmp(const FTSENT **, const FTSENT **);
+static void	sb_free(struct sb_names *);
+static void	sb_make(const char *, long);
+static uint64_t	sb_walk(const char *, int, struct sb_names *);
+
+int
+main(int argc, char *argv[])
+{
+	struct stat sb;
+	const struct sb_key *sk;
+	struct sb_names qnames, knames;
+	const char *dir;
+	uint64_t best, none, qsorted, keysorted, t;
+	long nentries;
+	size_t i, k;
+	int ch, j, rounds;
+
+	setprogname(argv[0]);
+
+	if (fsu_mount(&argc, &argv, MOUNT_READWRITE) != 0)
+		usage();
+
+	nentries = 100000;
+	rounds = 3;
+	while ((ch = getopt(argc, argv, "n:r:")) != -1) {
+		switch (ch) {
+		case 'n':
+			if ((nentries = atol(optarg)) < 1)
+				errx(EXIT_FAILURE, "-n %s: invalid value",
+				    optarg);
+			break;
+		case 'r':
+			if ((rounds = atoi(optarg)) < 1)
+				errx(EXIT_FAILURE, "-r %s: invalid value",
+				    optarg);
+			break;
+		case '?':
+		default:
+			usage();
+			/* NOTREACHED */
+		}
+	}
+	argc -= optind;
+	argv += optind;
+
+	if (argc > 1)
+		usage();
+	dir = argc == 1 ? argv[0] : "sortbench";
+
+	if (rump_sys_stat(dir, &sb) == -1) {
+		if (errno != ENOENT)
+			err(EXIT_FAILURE, "%s", dir);
+		sb_make(dir, nentries);
+	}
+
+	/* the first walk brings the directory into the caches */
+	sb_fn = NULL;
+	(void)sb_walk(dir, 0, NULL);
+	for (best = UINT64_MAX, j = 0; j < rounds; j++)
+		if ((t = sb_walk(dir, 0, NULL)) < best)
+			best = t;
+	none = best;
+
+	printf("%-8s %10s %10s %10s %s\n", "key", "unsorted", "qsort",
+	    "keysort", "order");
+	for (k = 0; k < sizeof(sb_keys) / sizeof(sb_keys[0]); k++) {
+		sk = &sb_keys[k];
+		sb_fn = sk->sk_cmp;
+
+		for (best = UINT64_MAX, j = 0; j < rounds; j++)
+			if ((t = sb_walk(dir, 0, NULL)) < best)
+				best = t;
+		qsorted = best;
+		for (best = UINT64_MAX, j = 0; j < rounds; j++)
+			if ((t = sb_walk(dir, sk->sk_key, NULL)) < best)
+				best = t;
+		keysorted = best;
+
+		memset(&qnames, 0, sizeof(qnames));
+		memset(&knames, 0, sizeof(knames));
+		(void)sb_walk(dir, 0, &qnames);
+		(void)sb_walk(dir, sk->sk_key, &knames);
+		for (i = 0; i < qnames.sn_count && i < knames.sn_count; i++)
+			if (strcmp(qnames.sn_names[i], knames.sn_names[i]) != 0)
+				break;
+
+		printf("%-8s %10.1f %10.1f %10.1f %s\n", sk->sk_name,
+		    none / 1e6, qsorted / 1e6, keysorted / 1e6,
+		    i == qnames.sn_count && i == knames.sn_count ? "same" :
+		    "DIFFERENT");
+
+		sb_free(&qnames);
+		sb_free(&knames);
+	}
+
+	return EXIT_SUCCESS;
+}
+
+static int
+sb_cmp(const FTSENT **a, const FTSENT **b)
+{
+
+	return sb_fn(*a, *b);
+}
+
+/* Files of random names, sizes and modification times. */
+static void
+sb_make(const char *dir, long nentries)
+{
+	char path[MAXPATHLEN];
+	struct timeval tv[2];
+	long i;
+	int fd;
+
+	if (rump_sys_mkdir(dir, 0755) == -1)
+		err(EXIT_FAILURE, "%s", dir);
+
+	srandom(1);
+	for (i = 0; i < nentries; i++) {
+		snprintf(path, sizeof(path), "%s/%lx.%ld", dir,
+		    random() >> (random() % 24), i);
+		fd = rump_sys_open(path, O_WRONLY | O_CREAT, 0644);
+		if (fd == -1)
+			err(EXIT_FAILURE, "%s", path);
+		/* sizes and times are shared, the names break the ties */
+		if (rump_sys_ftruncate(fd, random() % 4096) == -1)
+			err(EXIT_FAILURE, "%s", path);
+		rump_sys_close(fd);
+
+		tv[0].tv_sec = tv[1].tv_sec = 1000000000 + random() % 100000;
+		tv[0].tv_usec = tv[1].tv_usec = random() % 4 * 250000;
+		if (rump_sys_utimes(path, tv) == -1)
+			err(EXIT_FAILURE, "%s", path);
+	}
+}
+
+/*
+ * Walks dir sorted by sb_fn, or on key if it is not 0, and keeps the
+ * names of the entries below it if names is not NULL.
+ */
+static uint64_t
+sb_walk(const char *dir, int key, struct sb_names *names)
+{
+	char *paths[2];
+	FSU_FTS *fts;
+	FSU_FTSENT *p;
+	void *np;
+	uint64_t t0;
+	size_t size;
+
+	paths[0] = __UNCONST(dir);
+	paths[1] = NULL;
+
+	t0 = fsu_stats_clock();
+	if ((fts = fsu_fts_open(paths, FTS_PHYSICAL,
+	    sb_fn == NULL ? NULL : sb_cmp)) == NULL)
+		err(EXIT_FAILURE, "fsu_fts_open `%s'", dir);
+	if (key != 0 && fsu_fts_setsort(fts, key) != 0)
+		err(EXIT_FAILURE, "fsu_fts_setsort");
+	errno = 0;
+	while ((p = fsu_fts_read(fts)) != NULL) {
+		if (p->fts_level == FTS_ROOTLEVEL || names == NULL)
+			continue;
+		if (names->sn_count == names->sn_size) {
+			size = names->sn_size ? 2 * names->sn_size : 1024;
+			np = realloc(names->sn_names,
+			    size * sizeof(*names->sn_names));
+			if (np == NULL)
+				err(EXIT_FAILURE, NULL);
+			names->sn_names = np;
+			names->sn_size = size;
+		}
+		if ((names->sn_names[names->sn_count++] =
+		    strdup(p->fts_name)) == NULL)
+			err(EXIT_FAILURE, NULL);
+	}
+	if (errno != 0)
+		err(EXIT_FAILURE, "fsu_fts_read");
+	fsu_fts_close(fts);
+	return fsu_stats_clock() - t0;
+}
+
+static void
+sb_free(struct sb_names *names)
+{
+	size_t i;
+
+	for (i = 0; i < names->sn_count; i++)
+		free(names->sn_names[i]);
+	free(names->sn_names);
+}
+
+void
+usage(void)
+{
+
+	fprintf(stderr, "usage: %s %s [-n entries] [-r rounds] [dir]\n",
+	    getprogname(), fsu_mount_usage());
+
+	exit(EXIT_FAILURE);
+}
@@ -0,0 +1,302 @@
+/*
+ * Copyright (c) 2026 The fs-utils authors.  All Rights Reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS
+ * OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+#include "fs-utils.h"
+
+#include <sys/param.h>
+#include <sys/stat.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <rump/rumpdefs.h>
+#include <rump/rump_syscalls.h>
+
+#include <fsu_utils.h>
+#include <fsu_fts.h>
+#include <fsu_mount.h>
+#include <fsu_stats.h>
+
+#ifndef __NetBSD__
+#include "fsu_compat.h"
+#endif
+
+/*
+ * Times walks of two synthetic trees made in the image: "wide", one
+ * level of directories, and "deep", a complete binary tree of
+ * directories, every directory holding the same number of empty files.
+ * Each tree is walked by fsu_fts, then by fsu_pwalk with 1, 2, 4, ...
+ * threads, and the best time of the rounds is printed.  The trees are
+ * only made if the directory does not exist yet, so that an image can
+ * be filled once and walked by several runs.
+ */
+struct wb_count {
+	pthread_mutex_t wc_lock;
+	uint64_t wc_entries;
+};
+
+static int	wb_count(const struct fsu_pwent *, void *);
+static void	wb_deep(char *, int, int);
+static void	wb_files(const char *, int);
+static void	wb_mkdir(const char *);
+static uint64_t	wb_fts(const char *, uint64_t *);
+static uint64_t	wb_pwalk(const char *, int, int, uint64_t *);
+static void	wb_run(const char *, int, int, int);
+static void	usage(void);
+
+int
+main(int argc, char *argv[])
+{
+	char path[MAXPATHLEN];
+	struct stat sb;
+	const char *dir;
+	long l;
+	int ch, depth, files, maxthreads, oflag, rounds, width;
+
+	setprogname(argv[0]);
+
+	if (fsu_mount(&argc, &argv, MOUNT_READWRITE) != 0)
+		usage();
+
+	depth = 10;
+	files = 16;
+	oflag = 0;
+	rounds = 3;
+	width = 1000;
+	maxthreads = 32;
+	while ((ch = getopt(argc, argv, "d:f:or:t:w:")) != -1) {
+		switch (ch) {
+		case 'd':
+		case 'f':
+		case 'r':
+		case 't':
+		case 'w':
+			errno = 0;
+			l = strtol(optarg, NULL, 10);
+			if (errno != 0 || l < 1 || l > 1000000 ||
+			    (ch == 'd' && l > 20))
+				errx(EXIT_FAILURE, "-%c %s: invalid value",
+				    ch, optarg);
+			if (ch == 'd')
+				depth = l;
+			else if (ch == 'f')
+				files = l;
+			else if (ch == 'r')
+				rounds = l;
+			else if (ch == 't')
+				maxthreads = l;
+			else
+				width = l;
+			break;
+		case 'o':
+			oflag = 1;
+			break;
+		case '?':
+		default:
+			usage();
+			/* NOTREACHED */
+		}
+	}
+	argc -= optind;
+	argv += optind;
+
+	if (argc > 1)
+		usage();
+	dir = argc == 1 ? argv[0] : "walkbench";
+
+	if (rump_sys_stat(dir, &sb) == -1) {
+		if (errno != ENOENT)
+			err(EXIT_FAILURE, "%s", dir);
+		wb_mkdir(dir);
+		snprintf(path, sizeof(path), "%s/wide", dir);
+		wb_mkdir(path);
+		for (l = 0; l < width; l++) {
+			snprintf(path, sizeof(path), "%s/wide/d%ld", dir, l);
+			wb_mkdir(path);
+			wb_files(path, files);
+		}
+		snprintf(path, sizeof(path), "%s/deep", dir);
+		wb_deep(path, depth, files);
+	}
+
+	printf("%-6s %-9s %7s %10s %10s\n", "tree", "walker", "threads",
+	    "entries", "ms");
+	snprintf(path, sizeof(path), "%s/wide", dir);
+	wb_run(path, rounds, maxthreads, oflag);
+	snprintf(path, sizeof(path), "%s/deep", dir);
+	wb_run(path, rounds, maxthreads, oflag);
+
+	return EXIT_SUCCESS;
+}
+
+static void
+wb_mkdir(const char *path)
+{
+
+	if (rump_sys_mkdir(path, 0755) == -1)
+		err(EXIT_FAILURE, "%s", path);
+}
+
+static void
+wb_files(const char *dir, int files)
+{
+	char path[MAXPATHLEN];
+	int fd, i;
+
+	for (i = 0; i < files; i++) {
+		snprintf(path, sizeof(path), "%s/f%d", dir, i);
+		fd = rump_sys_open(path, O_WRONLY | O_CREAT, 0644);
+		if (fd == -1)
+			err(EXIT_FAILURE, "%s", path);
+		rump_sys_close(fd);
+	}
+}
+
+/* Makes path and two subdirectories of depth - 1 levels each. */
+static void
+wb_deep(char *path, int depth, int files)
+{
+	size_t len;
+
+	wb_mkdir(path);
+	wb_files(path, files);
+	if (depth == 0)
+		return;
+	len = strlen(path);
+	if (len + 3 >= MAXPATHLEN)
+		errx(EXIT_FAILURE, "%s: path too long", path);
+	strcpy(path + len, "/l");
+	wb_deep(path, depth - 1, files);
+	path[len + 1] = 'r';
+	wb_deep(path, depth - 1, files);
+	path[len] = '\0';
+}
+
+/* Walks tree a first time, then the given number of rounds. */
+static void
+wb_run(const char *tree, int rounds, int maxthreads, int oflag)
+{
+	const char *name;
+	uint64_t best, entries, t;
+	int i, n;
+
+	name = strrchr(tree, '/') + 1;
+
+	(void)wb_fts(tree, &entries);
+	for (best = UINT64_MAX, i = 0; i < rounds; i++)
+		if ((t = wb_fts(tree, &entries)) < best)
+			best = t;
+	printf("%-6s %-9s %7d %10" PRIu64 " %10.1f\n", name, "fsu_fts", 1,
+	    entries, best / 1e6);
+
+	for (n = 1;; n = n * 2 < maxthreads ? n * 2 : maxthreads) {
+		for (best = UINT64_MAX, i = 0; i < rounds; i++)
+			if ((t = wb_pwalk(tree, n, oflag, &entries)) < best)
+				best = t;
+		printf("%-6s %-9s %7d %10" PRIu64 " %10.1f\n", name,
+		    "fsu_pwalk", n, entries, best / 1e6);
+		if (n == maxthreads)
+			break;
+	}
+}
+
+/* The serial baseline, stat'ing every entry as fsu_pwalk does. */
+static uint64_t
+wb_fts(const char *tree, uint64_t *entries)
+{
+	char *paths[2];
+	FSU_FTS *fts;
+	FSU_FTSENT *p;
+	uint64_t t0;
+
+	paths[0] = __UNCONST(tree);
+	paths[1] = NULL;
+	*entries = 0;
+
+	t0 = fsu_stats_clock();
+	errno = 0;
+	if ((fts = fsu_fts_open(paths, FTS_PHYSICAL, NULL)) == NULL)
+		err(EXIT_FAILURE, "fsu_fts_open `%s'", tree);
+	while ((p = fsu_fts_read(fts)) != NULL)
+		if (p->fts_info != FTS_DP)
+			++*entries;
+	if (errno != 0)
+		err(EXIT_FAILURE, "fsu_fts_read");
+	fsu_fts_close(fts);
+	return fsu_stats_clock() - t0;
+}
+
+static uint64_t
+wb_pwalk(const char *tree, int nthreads, int oflag, uint64_t *entries)
+{
+	struct wb_count wc;
+	uint64_t t0;
+
+	pthread_mutex_init(&wc.wc_lock, NULL);
+	wc.wc_entries = 0;
+
+	t0 = fsu_stats_clock();
+	if (fsu_pwalk(tree, oflag ? FSU_PWALK_ORDERED : 0, nthreads,
+	    wb_count, &wc) != 0)
+		err(EXIT_FAILURE, "fsu_pwalk `%s'", tree);
+	t0 = fsu_stats_clock() - t0;
+
+	pthread_mutex_destroy(&wc.wc_lock);
+	*entries = wc.wc_entries;
+	return t0;
+}
+
+/* The callback is called concurrently without -o. */
+static int
+wb_count(const struct fsu_pwent *pe, void *arg)
+{
+	struct wb_count *wc;
+
+	wc = arg;
+	if (pe->pe_errno != 0)
+		errx(EXIT_FAILURE, "%s: %s", pe->pe_path,
+		    strerror(pe->pe_errno));
+	pthread_mutex_lock(&wc->wc_lock);
+	wc->wc_entries++;
+	pthread_mutex_unlock(&wc->wc_lock);
+	return 0;
+}
+
+static void
+usage(void)
+{
+
+	fprintf(stderr, "usage: %s %s [-o] [-d depth] [-f files] [-r rounds] "
+	    "[-t threads] [-w width] [dir]\n", getprogname(),
+	    fsu_mount_usage());
+
+	exit(EXIT_FAILURE);
+}
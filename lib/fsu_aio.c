@@ -0,0 +1,174 @@
+/*
+ * Copyright (c) 2026 The fs-utils authors.  All Rights Reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS
+ * OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include "fs-utils.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <stdbool.h>
+#include <stdlib.h>
+
+#include <fsu_utils.h>
+
+#include "fsu_compat.h"
+#include "fsu_io.h"
+
+/*
+ * Asynchronous reads and writes on rump file descriptors, run by the
+ * I/O threads.  Completed requests are reaped from the queue they were
+ * submitted to, in completion order.
+ */
+
+struct fsu_aioq {
+	struct fsu_iocq q_cq;
+	int q_count;		/* requests submitted and not reaped */
+};
+
+struct fsu_aio {
+	struct fsu_ioreq a_req;	/* first, completion queues link requests */
+	void *a_cookie;
+};
+
+static int	fsu_aio_submit(FSU_AIOQ *, int, int, void *, size_t, off_t,
+		    void *);
+
+FSU_AIOQ *
+fsu_aioq_create(void)
+{
+	FSU_AIOQ *q;
+
+	q = malloc(sizeof(FSU_AIOQ));
+	if (q == NULL)
+		return NULL;
+	fsu_iocq_init(&q->q_cq);
+	q->q_count = 0;
+	return q;
+}
+
+/* Waits for the requests still in flight and frees the queue */
+void
+fsu_aioq_destroy(FSU_AIOQ *q)
+{
+	struct fsu_ioreq *req;
+
+	assert(q != NULL);
+
+	while ((req = fsu_iocq_get(&q->q_cq, true)) != NULL)
+		free(req);
+	fsu_iocq_destroy(&q->q_cq);
+	free(q);
+}
+
+int
+fsu_aread(FSU_AIOQ *q, int fd, void *buf, size_t nbytes, off_t off,
+    void *cookie)
+{
+
+	return fsu_aio_submit(q, FSU_IO_READ, fd, buf, nbytes, off, cookie);
+}
+
+int
+fsu_awrite(FSU_AIOQ *q, int fd, const void *buf, size_t nbytes, off_t off,
+    void *cookie)
+{
+
+	return fsu_aio_submit(q, FSU_IO_WRITE, fd, __UNCONST(buf), nbytes, off,
+	    cookie);
+}
+
+/*
+ * Reaps between min and nev completed requests into ev, blocking until
+ * min of them have completed.  Fewer than min are returned only if no
+ * more request is in flight.  Returns the number of events.
+ */
+int
+fsu_aioq_wait(FSU_AIOQ *q, struct fsu_aioev *ev, int min, int nev)
+{
+	struct fsu_ioreq *req;
+	struct fsu_aio *aio;
+	int n;
+
+	assert(q != NULL);
+
+	if (min < 0 || nev < min || (nev > 0 && ev == NULL)) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	for (n = 0; n < nev; ++n) {
+		req = fsu_iocq_get(&q->q_cq, n < min);
+		if (req == NULL)
+			break;
+
+		aio = (struct fsu_aio *)req;
+		ev[n].ev_cookie = aio->a_cookie;
+		ev[n].ev_buf = req->ior_buf;
+		ev[n].ev_off = req->ior_off;
+		ev[n].ev_rv = req->ior_rv;
+		ev[n].ev_errno = req->ior_errno;
+		free(aio);
+		--q->q_count;
+	}
+	return n;
+}
+
+/* Number of requests submitted to the queue and not reaped yet */
+int
+fsu_aioq_pending(FSU_AIOQ *q)
+{
+
+	assert(q != NULL);
+
+	return q->q_count;
+}
+
+static int
+fsu_aio_submit(FSU_AIOQ *q, int op, int fd, void *buf, size_t nbytes,
+    off_t off, void *cookie)
+{
+	struct fsu_aio *aio;
+
+	assert(q != NULL);
+
+	if (off < 0) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	aio = malloc(sizeof(struct fsu_aio));
+	if (aio == NULL)
+		return -1;
+	aio->a_req.ior_cq = &q->q_cq;
+	aio->a_req.ior_op = op;
+	aio->a_req.ior_fd = fd;
+	aio->a_req.ior_buf = buf;
+	aio->a_req.ior_len = nbytes;
+	aio->a_req.ior_off = off;
+	aio->a_cookie = cookie;
+
+	++q->q_count;
+	fsu_io_submit(&aio->a_req);
+	return 0;
+}
@@ -11,6 +11,11 @@
 #define __UNCONST(a) ((char *)(unsigned long)(const char *)(a))
 #endif
 
+/* the limit of the rump kernel, which is NetBSD's */
+#ifndef IOV_MAX
+#define IOV_MAX 1024
+#endif
+
 int	string_to_flags(char **, unsigned long *, unsigned long *);
 char    *flags_to_string(unsigned long, const char *);
 int 	humanize_number(char *, size_t, int64_t, const char *, int, int);
@@ -0,0 +1,144 @@
+/*
+ * Copyright (c) 2026 The fs-utils authors.  All Rights Reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS
+ * OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <sys/param.h>
+#include <sys/stat.h>
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <rump/rump_syscalls.h>
+
+#include <fsu_utils.h>
+
+/* size of the transfers of fsu_copy_range */
+#define FSU_COPY_CHUNK (1024 * 1024)
+
+static bool	fsu_iszero(const uint8_t *, size_t);
+
+/*
+ * Copies len bytes at offin of the rump file descriptor fdin to offout
+ * of fdout, stopping early at the end of fdin.  The next chunk is read
+ * while the current one is written.  When fdin is sparse, chunks of
+ * zeroes past the end of fdout are skipped rather than written, leaving
+ * holes.  Returns the number of bytes copied or -1.
+ */
+off_t
+fsu_copy_range(int fdin, off_t offin, int fdout, off_t offout, off_t len)
+{
+	struct stat sin, sout;
+	struct fsu_aioev ev;
+	FSU_AIOQ *q;
+	uint8_t *bufs, *cur, *next;
+	ssize_t rd, wr;
+	off_t done, end;
+	size_t want;
+	bool sparse;
+	int rv;
+
+	if (offin < 0 || offout < 0 || len < 0) {
+		errno = EINVAL;
+		return -1;
+	}
+	if (len == 0)
+		return 0;
+
+	if (rump_sys_fstat(fdin, &sin) == -1 ||
+	    rump_sys_fstat(fdout, &sout) == -1)
+		return -1;
+	sparse = S_ISREG(sin.st_mode) &&
+	    (off_t)sin.st_blocks * 512 < sin.st_size;
+
+	bufs = malloc(2 * FSU_COPY_CHUNK);
+	if (bufs == NULL)
+		return -1;
+	q = fsu_aioq_create();
+	if (q == NULL) {
+		free(bufs);
+		return -1;
+	}
+	cur = bufs;
+	next = bufs + FSU_COPY_CHUNK;
+
+	rv = 0;
+	done = 0;
+	want = (size_t)MIN(len, FSU_COPY_CHUNK);
+	rd = rump_sys_pread(fdin, cur, want, offin);
+	while (rd > 0) {
+		/* read the next chunk while this one is written */
+		if ((size_t)rd == want && done + rd < len) {
+			want = (size_t)MIN(len - done - rd, FSU_COPY_CHUNK);
+			if (fsu_aread(q, fdin, next, want, offin + done + rd,
+				NULL) == -1) {
+				rv = -1;
+				break;
+			}
+		}
+
+		if (sparse && offout + done >= sout.st_size &&
+		    fsu_iszero(cur, (size_t)rd))
+			wr = rd;
+		else
+			wr = rump_sys_pwrite(fdout, cur, (size_t)rd,
+			    offout + done);
+		if (wr != rd) {
+			if (wr != -1)
+				errno = EIO;
+			rv = -1;
+			break;
+		}
+		done += rd;
+
+		if (fsu_aioq_pending(q) == 0)
+			break;
+		fsu_aioq_wait(q, &ev, 1, 1);
+		if ((rd = ev.ev_rv) == -1)
+			errno = ev.ev_errno;
+		next = cur;
+		cur = ev.ev_buf;
+	}
+	if (rd == -1)
+		rv = -1;
+
+	/* holes at the end still have to extend the file */
+	end = offout + done;
+	if (rv == 0 && sparse && end > sout.st_size &&
+	    rump_sys_ftruncate(fdout, end) == -1)
+		rv = -1;
+
+	fsu_aioq_destroy(q);
+	free(bufs);
+	return rv == -1 ? -1 : done;
+}
+
+static bool
+fsu_iszero(const uint8_t *buf, size_t len)
+{
+
+	return len == 0 || (buf[0] == 0 && memcmp(buf, buf + 1, len - 1) == 0);
+}
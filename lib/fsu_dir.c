@@ -46,6 +46,7 @@
 #include <assert.h>
 #include <dirent.h>
 #include <stdint.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -53,35 +54,127 @@
 #include <rump/rumpdefs.h>
 #include <fsu_utils.h>
 
+#include "fsu_stats.h"
+
+/*
+ * Bounds of the getdents buffer of a directory, it starts at the size
+ * hinted and doubles at each read of a directory which goes on.
+ */
+#define FSU_DIR_BUFMIN (8192)
+#define FSU_DIR_BUFMAX (256 * 1024)
+
+/* entries read at once by fsu_getdirname */
+#define FSU_DIR_NBATCH (64)
+
+/* size of the inode to name cache, a power of 2 */
+#define FSU_NCACHE_SIZE (256)
+
+struct fsu_ncache {
+	ino_t nc_ino;
+	char *nc_name;
+};
+
+static int fsu_dir_fill(FSU_DIR *);
+static char *fsu_getcwd_walk(void);
 static char *fsu_getdirname(void);
+static char *fsu_ncache_lookup(ino_t);
+static void fsu_ncache_enter(ino_t, const char *);
+
+/*
+ * Absolute path of the current directory as followed by fsu_chdir, or
+ * NULL if unknown.  It is checked against "." before being used, so a
+ * chdir done behind our back only costs a walk up to the root.
+ */
+static char *fsu_cwd;
+
+static struct fsu_ncache fsu_ncache[FSU_NCACHE_SIZE];
 
 FSU_DIR
 *fsu_opendir(const char *path)
 {
-	FSU_DIR *dir;
 
-	assert(path != NULL);
+	return fsu_opendir_hint(path, 0);
+}
+
+/* Allocates a directory stream with a buffer for about hint bytes */
+static FSU_DIR
+*fsu_dir_alloc(size_t hint)
+{
+	FSU_DIR *dir;
+	size_t size;
 
 	dir = malloc(sizeof(FSU_DIR));
 	if (dir == NULL)
 		return NULL;
 	memset(dir, 0, sizeof(FSU_DIR));
 
+	for (size = FSU_DIR_BUFMIN; size < hint && size < FSU_DIR_BUFMAX;)
+		size <<= 1;
+	dir->dd_buf = malloc(size);
+	if (dir->dd_buf == NULL) {
+		free(dir);
+		return NULL;
+	}
+	dir->dd_bufsize = size;
+	return dir;
+}
+
+/*
+ * Opens a directory whose entries take about hint bytes, its st_size,
+ * to read it with fewer getdents.
+ */
+FSU_DIR
+*fsu_opendir_hint(const char *path, size_t hint)
+{
+	FSU_DIR *dir;
+	uint64_t t0;
+
+	assert(path != NULL);
+
+	dir = fsu_dir_alloc(hint);
+	if (dir == NULL)
+		return NULL;
+
+	t0 = fsu_stats_clock();
 	dir->dd_fd = rump_sys_open(path, RUMP_O_RDONLY|RUMP_O_DIRECTORY);
+	fsu_stats_syscall(&dir->dd_stats, t0);
 
 	if (dir->dd_fd  == -1) {
+		free(dir->dd_buf);
 		free(dir);
 		return NULL;
 	}
 	return dir;
 }
 
+/*
+ * Reads the directory open as the rump descriptor fd, which is closed
+ * with the stream.  The hint is as for fsu_opendir_hint.
+ */
+FSU_DIR
+*fsu_fdopendir(int fd, size_t hint)
+{
+	FSU_DIR *dir;
+
+	dir = fsu_dir_alloc(hint);
+	if (dir == NULL)
+		return NULL;
+	dir->dd_fd = fd;
+	return dir;
+}
+
 void
 fsu_closedir(FSU_DIR *dir)
 {
 
+	uint64_t t0;
+
 	assert(dir != NULL);
+	t0 = fsu_stats_clock();
 	rump_sys_close(dir->dd_fd);
+	fsu_stats_syscall(&dir->dd_stats, t0);
+	fsu_stats_dclosed(&dir->dd_stats);
+	free(dir->dd_buf);
 	free(dir);
 }
 
@@ -93,14 +186,8 @@ struct dirent
 	assert(dir != NULL);
 
  retry:
-	if (dir->dd_size <= 0) {
-		dir->dd_size = rump_sys_getdents(dir->dd_fd, (char*)dir->dd_buf,
-			sizeof(dir->dd_buf));
-		if (dir->dd_size <= 0)
-			return NULL;
-
-		dir->dd_dent = (struct dirent *)dir->dd_buf;
-	}
+	if (dir->dd_size <= 0 && fsu_dir_fill(dir) <= 0)
+		return NULL;
 
 	dent = dir->dd_dent;
 	dir->dd_size -= _DIRENT_SIZE(dir->dd_dent);
@@ -113,16 +200,106 @@ struct dirent
 	return dent;
 }
 
+/*
+ * Reads up to nent entries of dir into ents, their names point to the
+ * buffer of dir and stay valid until it is read again.  Returns the
+ * number of entries, 0 at the end of the directory and -1 on error.
+ */
+int
+fsu_readdir_batch(FSU_DIR *dir, struct fsu_dirent *ents, int nent)
+{
+	struct dirent *dent;
+	int n;
+
+	assert(dir != NULL && ents != NULL && nent > 0);
+
+	for (n = 0; n == 0;) {
+		if (dir->dd_size <= 0 && fsu_dir_fill(dir) <= 0)
+			return dir->dd_size;
+
+		for (; n < nent && dir->dd_size > 0;) {
+			dent = dir->dd_dent;
+			dir->dd_size -= _DIRENT_SIZE(dent);
+			dir->dd_dent = _DIRENT_NEXT(dent);
+
+			/* don't return dirents for removed files */
+#ifdef HAVE_STRUCT_DIRENT_D_INO
+			if (dent->d_ino == 0)
+				continue;
+			ents[n].de_ino = dent->d_ino;
+#else
+			if (dent->d_fileno == 0)
+				continue;
+			ents[n].de_ino = dent->d_fileno;
+#endif
+			ents[n].de_name = dent->d_name;
+#ifdef HAVE_STRUCT_DIRENT_D_NAMLEN
+			ents[n].de_namlen = dent->d_namlen;
+#else
+			ents[n].de_namlen = strlen(dent->d_name);
+#endif
+#ifdef DT_UNKNOWN
+			ents[n].de_type = dent->d_type;
+#else
+			ents[n].de_type = 0;
+#endif
+			++n;
+		}
+	}
+	return n;
+}
+
 void
 fsu_rewinddir(FSU_DIR *dir)
 {
 
 	assert(dir != NULL);
 
+	++dir->dd_stats.ios_seeks;
+	rump_sys_lseek(dir->dd_fd, 0, SEEK_SET);
 	dir->dd_off = 0;
 	dir->dd_size = 0;
 }
 
+/*
+ * Refills the buffer of dir with getdents, a bigger buffer is used
+ * once the directory took more than one.  Returns what getdents did.
+ */
+static int
+fsu_dir_fill(FSU_DIR *dir)
+{
+	uint8_t *buf;
+	uint64_t t0;
+
+	if (dir->dd_off > 0 && dir->dd_bufsize < FSU_DIR_BUFMAX &&
+	    (buf = malloc(dir->dd_bufsize << 1)) != NULL) {
+		free(dir->dd_buf);
+		dir->dd_buf = buf;
+		dir->dd_bufsize <<= 1;
+	}
+
+	++dir->dd_stats.ios_fills;
+	t0 = fsu_stats_clock();
+	dir->dd_size = rump_sys_getdents(dir->dd_fd, (char *)dir->dd_buf,
+	    dir->dd_bufsize);
+	fsu_stats_syscall(&dir->dd_stats, t0);
+	if (dir->dd_size > 0) {
+		dir->dd_stats.ios_bread += dir->dd_size;
+		dir->dd_off += dir->dd_size;
+	}
+	dir->dd_dent = (struct dirent *)dir->dd_buf;
+	return dir->dd_size;
+}
+
+void
+fsu_dirstats(FSU_DIR *dir, struct fsu_iostats *st)
+{
+
+	assert(dir != NULL && st != NULL);
+
+	*st = dir->dd_stats;
+}
+
 char *
 fsu_getapath(const char *dir)
 {
@@ -133,13 +310,13 @@ fsu_getapath(const char *dir)
 	fname = p = NULL;
 	old_dir = fsu_getcwd();
 
-	if (rump_sys_chdir(dir) != 0) {
+	if (fsu_chdir(dir) != 0) {
 		new_dir = strdup(dir);
 		p = strrchr(new_dir, '/');
 		if (p != NULL) {
 			*p = 0;
 			fname = dir + (p - new_dir) + 1;
-			if (rump_sys_chdir(new_dir) != 0) {
+			if (fsu_chdir(new_dir) != 0) {
 				free(new_dir);
 				free(old_dir);
 				return NULL;
@@ -165,16 +342,111 @@ fsu_getapath(const char *dir)
 		new_dir[new_size - 1] = 0;
 	}
 
-	rump_sys_chdir(old_dir);
+	fsu_chdir(old_dir);
 	free(old_dir);
 	return new_dir;
 }
 
+/*
+ * Changes the current directory and follows its path lexically, no
+ * system call is needed besides the chdir.
+ */
+int
+fsu_chdir(const char *path)
+{
+	const char *p, *q;
+	char *cwd;
+	size_t len, n;
+
+	assert(path != NULL);
+
+	if (rump_sys_chdir(path) != 0)
+		return -1;
+
+	if (path[0] != '/' && fsu_cwd == NULL)
+		return 0;
+
+	len = path[0] == '/' ? 1 : strlen(fsu_cwd);
+	cwd = malloc(len + strlen(path) + 2);
+	if (cwd == NULL) {
+		free(fsu_cwd);
+		fsu_cwd = NULL;
+		return 0;
+	}
+	if (path[0] == '/')
+		cwd[0] = '/';
+	else
+		memcpy(cwd, fsu_cwd, len);
+
+	for (p = path; *p != '\0'; p = q) {
+		for (; *p == '/'; ++p)
+			continue;
+		for (q = p; *q != '\0' && *q != '/'; ++q)
+			continue;
+		n = q - p;
+
+		if (n == 0 || (n == 1 && p[0] == '.'))
+			continue;
+		if (n == 2 && p[0] == '.' && p[1] == '.') {
+			while (len > 1 && cwd[len - 1] != '/')
+				--len;
+			if (len > 1)
+				--len;
+			continue;
+		}
+		if (len > 1)
+			cwd[len++] = '/';
+		memcpy(cwd + len, p, n);
+		len += n;
+	}
+	cwd[len] = '\0';
+
+	free(fsu_cwd);
+	fsu_cwd = cwd;
+	return 0;
+}
+
+/*
+ * Changes the current directory to the one open on fd.  Its path is
+ * not known, it is looked up again by the next fsu_getcwd.
+ */
+int
+fsu_fchdir(int fd)
+{
+
+	if (rump_sys_fchdir(fd) != 0)
+		return -1;
+
+	free(fsu_cwd);
+	fsu_cwd = NULL;
+	return 0;
+}
+
 #define ALLOC_SIZE (10)
 
-/* Gets the absolute path of the current directory */
+/*
+ * Gets the absolute path of the current directory.  The path followed
+ * by fsu_chdir is used if it still leads to ".", otherwise it is found
+ * by walking up to the root.
+ */
 char
 *fsu_getcwd(void)
+{
+	struct stat dot, st;
+
+	if (fsu_cwd != NULL && rump_sys_stat(".", &dot) == 0 &&
+	    rump_sys_stat(fsu_cwd, &st) == 0 &&
+	    dot.st_ino == st.st_ino && dot.st_dev == st.st_dev)
+		return strdup(fsu_cwd);
+
+	free(fsu_cwd);
+	fsu_cwd = fsu_getcwd_walk();
+	return fsu_cwd == NULL ? NULL : strdup(fsu_cwd);
+}
+
+/* Gets the absolute path of the current directory from its parents */
+static char
+*fsu_getcwd_walk(void)
 {
 	int i, rv;
 	char **names, **tmpnames;
@@ -227,8 +499,10 @@ char
 	for (--i; i >= 0; --i) {
 		rv = strlcat(dirname, names[i], len);
 		free(names[i]);
-		dirname[rv] = '/';
-		dirname[rv + 1] = '\0';
+		if (i > 0) {
+			dirname[rv] = '/';
+			dirname[rv + 1] = '\0';
+		}
 	}
 	free(names);
 
@@ -250,10 +524,11 @@ static ino_t root_ino = 0;
 static char
 *fsu_getdirname(void)
 {
+	struct fsu_dirent ents[FSU_DIR_NBATCH];
 	struct stat dot;
-	struct dirent *dent;
-	int fd, rv, size;
-	uint8_t buf[8192];
+	FSU_DIR *dir;
+	int i, n, rv;
+	char *name;
 
 	if (root_ino == 0) {
 		rv = rump_sys_stat("/", &dot);
@@ -269,27 +544,60 @@ static char
 	if (dot.st_ino == root_ino)
 		return strdup("/");
 
-	fd = rump_sys_open("..", RUMP_O_RDONLY|RUMP_O_DIRECTORY);
-	assert(fd >= 0);
-	for (;;) {
-		size = rump_sys_getdents(fd, (char *)buf, sizeof(buf));
-		if (size == -1) {
-			warn("..");
-			return NULL;
-		} else if (size == 0)
-			return NULL;
-		dent = (struct dirent *)buf;
+	if ((name = fsu_ncache_lookup(dot.st_ino)) != NULL)
+		return name;
 
-		while (size > 0) {
-#ifdef HAVE_STRUCT_DIRENT_D_INO
-			if (dent->d_ino == dot.st_ino)
-#else
-			if (dent->d_fileno == dot.st_ino)
-#endif
-				return strdup(dent->d_name);
-			size -= _DIRENT_SIZE(dent);
-			dent = _DIRENT_NEXT(dent);
+	if ((dir = fsu_opendir("..")) == NULL) {
+		warn("..");
+		return NULL;
+	}
+	while ((n = fsu_readdir_batch(dir, ents, FSU_DIR_NBATCH)) > 0) {
+		for (i = 0; i < n; ++i) {
+			if (ents[i].de_ino != dot.st_ino)
+				continue;
+			fsu_ncache_enter(dot.st_ino, ents[i].de_name);
+			name = strdup(ents[i].de_name);
+			fsu_closedir(dir);
+			return name;
 		}
 	}
-	/* NOTREACHED */
+	if (n == -1)
+		warn("..");
+	fsu_closedir(dir);
+	return NULL;
+}
+
+/*
+ * Looks up the name of the directory ino in its parent, the entry is
+ * only trusted if "../name" still is ino.
+ */
+static char *
+fsu_ncache_lookup(ino_t ino)
+{
+	struct fsu_ncache *nc;
+	struct stat sb;
+	char path[MAXNAMLEN + 4];
+
+	nc = &fsu_ncache[ino & (FSU_NCACHE_SIZE - 1)];
+	if (nc->nc_name == NULL || nc->nc_ino != ino)
+		return NULL;
+
+	snprintf(path, sizeof(path), "../%s", nc->nc_name);
+	if (rump_sys_lstat(path, &sb) == -1 || sb.st_ino != ino)
+		return NULL;
+	return strdup(nc->nc_name);
+}
+
+static void
+fsu_ncache_enter(ino_t ino, const char *name)
+{
+	struct fsu_ncache *nc;
+	char *p;
+
+	if ((p = strdup(name)) == NULL)
+		return;
+	nc = &fsu_ncache[ino & (FSU_NCACHE_SIZE - 1)];
+	free(nc->nc_name);
+	nc->nc_ino = ino;
+	nc->nc_name = p;
 }
@@ -32,16 +32,77 @@
 #include <assert.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <limits.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+#include <rump/rumpdefs.h>
 #include <rump/rump_syscalls.h>
 
 #include <fsu_utils.h>
 
+#include "fsu_compat.h"
+#include "fsu_io.h"
+#include "fsu_stats.h"
+
+/* number of preferred I/O size blocks buffered by default */
+#define FSU_BUFNBLK (16)
+
+/* sequential refills in a row before reading ahead */
+#define FSU_RASEQ (2)
+
+/* Read-ahead or write-behind buffers of a stream */
+struct fsu_fring {
+	int fr_depth;		/* number of buffers */
+	int fr_head;		/* oldest buffer in flight */
+	int fr_count;		/* number of buffers in flight */
+	int fr_seq;		/* read-ahead: sequential refills in a row */
+	off_t fr_expect;	/* read-ahead: position of the next refill */
+	off_t fr_next;		/* read-ahead: position of the next buffer */
+	struct fsu_ioreq fr_req[1]; /* one request per buffer */
+};
+
+/* Block of the file kept by the cache of a stream */
+struct fsu_fblock {
+	off_t fb_off;		/* position in the file, -1 if unused */
+	size_t fb_len;		/* bytes read, less than a buffer at EOF */
+	uint64_t fb_used;	/* last use, for LRU replacement */
+	uint8_t *fb_buf;
+};
+
+/* Block cache of a stream, the buffer is the last block used */
+struct fsu_fcache {
+	int fc_nblocks;		/* number of blocks */
+	uint64_t fc_clock;	/* incremented on every use of a block */
+	uint8_t *fc_buf;	/* buffer of the stream without the cache */
+	struct fsu_fblock fc_blocks[1];
+};
+
+static int	fsu_fgrow(char **, size_t *, size_t);
+static char	*fsu_fscan(FSU_FILE *, int, size_t *, char **, size_t *);
+static void	fsu_fc_fill(FSU_FILE *);
+static void	fsu_fc_free(FSU_FILE *);
+static size_t	fsu_fbufsize(FSU_FILE *, struct stat *);
+static int	fsu_fiovlen(const struct iovec *, int, size_t *);
+static ssize_t	fsu_fsys_pread(FSU_FILE *, void *, size_t, off_t);
+static ssize_t	fsu_fsys_pwrite(FSU_FILE *, const void *, size_t, off_t);
 static void	fsu_fill_buffer(FSU_FILE *);
+static size_t	fsu_fread_direct(FSU_FILE *, char *, size_t);
+static size_t	fsu_fwroom(FSU_FILE *);
+static bool	fsu_fwoverlap(FSU_FILE *, off_t, size_t);
+static struct fsu_fring *fsu_fring_alloc(size_t, int);
+static bool	fsu_fring_bufs(struct fsu_fring *, size_t);
+static void	fsu_fring_free(struct fsu_fring *);
+static void	fsu_ra_drain(FSU_FILE *);
+static bool	fsu_ra_fill(FSU_FILE *);
+static void	fsu_ra_free(FSU_FILE *);
+static void	fsu_ra_start(FSU_FILE *);
+static void	fsu_wb_drain(FSU_FILE *);
+static void	fsu_wb_free(FSU_FILE *);
+static int	fsu_wb_push(FSU_FILE *);
+static bool	fsu_wb_wait(FSU_FILE *);
 
 char
 fsu_fgetc(FSU_FILE *file)
@@ -58,7 +119,13 @@ fsu_fgetc(FSU_FILE *file)
 		if (file->fd_eof || file->fd_err != 0)
 			return EOF;
 
+		/*
+		 * A buffer filled exactly leaves the EOF to the next refill,
+		 * as does a seek.
+		 */
 		fsu_fill_buffer(file);
+		if (file->fd_fpos == file->fd_last || file->fd_err != 0)
+			return EOF;
 	}
 	++file->fd_fpos;
 
@@ -76,16 +143,152 @@ fsu_fputc(int c, FSU_FILE *file)
 		return EOF;
 	}
 
+	if (file->fd_err != 0)
+		return EOF;
+
+	/* the buffer is not refilled, what is past fd_bpos is not written */
+	if (fsu_fwroom(file) == 0 && fsu_wb_push(file) == -1)
+		return EOF;
+
+	++file->fd_fpos;
+	if (file->fd_fpos > file->fd_last)
+		file->fd_last = file->fd_fpos;
+	file->fd_dirty = true;
+
+	return (file->fd_buf[file->fd_bpos++] = c);
+}
+
+/*
+ * Returns the next line, not NUL terminated, and its length.  The line
+ * is in the buffer of the stream unless it spans several refills, it
+ * remains valid until the next access to the stream.
+ */
+char *
+fsu_fgetln(FSU_FILE *file, size_t *len)
+{
+
+	assert(file != NULL && len != NULL);
+
+	return fsu_fscan(file, '\n', len, &file->fd_lbuf,
+	    &file->fd_lbufsize);
+}
+
+ssize_t
+fsu_getdelim(char **lineptr, size_t *n, int delim, FSU_FILE *file)
+{
+	char *p;
+	size_t len;
+
+	assert(file != NULL);
+
+	if (lineptr == NULL || n == NULL) {
+		errno = EINVAL;
+		return -1;
+	}
+	if (*lineptr == NULL)
+		*n = 0;
+
+	/* lines spanning refills are gathered in *lineptr directly */
+	p = fsu_fscan(file, delim, &len, lineptr, n);
+	if (p == NULL)
+		return -1;
+
+	if (p != *lineptr) {
+		if (fsu_fgrow(lineptr, n, len + 1) == -1)
+			return -1;
+		memcpy(*lineptr, p, len);
+	}
+	(*lineptr)[len] = '\0';
+	return len;
+}
+
+ssize_t
+fsu_getline(char **lineptr, size_t *n, FSU_FILE *file)
+{
+
+	return fsu_getdelim(lineptr, n, '\n', file);
+}
+
+/*
+ * Reads up to and including the next delim.  If it is in the buffer,
+ * a pointer to the buffer is returned, otherwise the data are gathered
+ * across refills in *bufp, grown as needed and with room left for a NUL.
+ * Returns NULL at EOF or on error.
+ */
+static char *
+fsu_fscan(FSU_FILE *file, int delim, size_t *lenp, char **bufp,
+    size_t *sizep)
+{
+	uint8_t *p, *q;
+	size_t len, n;
+
+	if ((file->fd_mode & FSU_FILE_READ) == 0) {
+		errno = EBADF;
+		return NULL;
+	}
+
 	if (file->fd_fpos == file->fd_last) {
 		if (file->fd_eof || file->fd_err != 0)
-			return EOF;
+			return NULL;
+		fsu_fill_buffer(file);
+		if (file->fd_fpos == file->fd_last)
+			return NULL;
+	}
+
+	p = file->fd_buf + file->fd_bpos;
+	q = memchr(p, delim, file->fd_last - file->fd_fpos);
+	if (q != NULL) {
+		len = q - p + 1;
+		file->fd_bpos += len;
+		file->fd_fpos += len;
+		*lenp = len;
+		return (char *)p;
+	}
+
+	len = 0;
+	for (;;) {
+		p = file->fd_buf + file->fd_bpos;
+		n = file->fd_last - file->fd_fpos;
+		if ((q = memchr(p, delim, n)) != NULL)
+			n = q - p + 1;
+
+		if (fsu_fgrow(bufp, sizep, len + n + 1) == -1) {
+			file->fd_err = errno;
+			return NULL;
+		}
+		memcpy(*bufp + len, p, n);
+		len += n;
+		file->fd_bpos += n;
+		file->fd_fpos += n;
 
+		if (q != NULL || file->fd_eof || file->fd_err != 0)
+			break;
 		fsu_fill_buffer(file);
+		if (file->fd_fpos == file->fd_last)
+			break;
 	}
-	++file->fd_fpos;
-	file->fd_dirty = true;
+	*lenp = len;
+	return *bufp;
+}
 
-	return (file->fd_buf[file->fd_bpos++] = c);
+/* Grows *bufp, of *sizep bytes, to hold at least size bytes */
+static int
+fsu_fgrow(char **bufp, size_t *sizep, size_t size)
+{
+	char *nbuf;
+	size_t nsize;
+
+	if (size <= *sizep)
+		return 0;
+
+	for (nsize = *sizep > 0 ? *sizep : 128; nsize < size; nsize *= 2)
+		continue;
+	nbuf = realloc(*bufp, nsize);
+	if (nbuf == NULL)
+		return -1;
+	*bufp = nbuf;
+	*sizep = nsize;
+	return 0;
 }
 
 
@@ -94,27 +297,30 @@ FSU_FILE
 {
 	FSU_FILE *file;
 	struct stat sb;
-	int rv, flags;
+	uint64_t t0;
+	int rv, flags, saved_errno;
 	mode_t mask;
 
 	umask((mask = umask(0)));
 	mask = ~mask;
 	flags = 0;
 
-#ifdef EFTYPE
-	if (strchr(mode, 'f') != NULL && !S_ISREG(sb.st_mode)) {
-		errno = EFTYPE;
-		return NULL;
-	}
-#endif
 	file = malloc(sizeof(FSU_FILE));
 	if (file == NULL)
 		return NULL;
 
+	file->fd_buf = NULL;
+	file->fd_bufsize = file->fd_blksize = 0;
+	file->fd_freebuf = false;
 	file->fd_err = 0;
 	file->fd_fpos = file->fd_bpos = file->fd_last = 0;
 	file->fd_mode = 0;
 	file->fd_eof = file->fd_dirty = false;
+	file->fd_lbuf = NULL;
+	file->fd_lbufsize = 0;
+	file->fd_ra = file->fd_wb = NULL;
+	file->fd_cache = NULL;
+	memset(&file->fd_stats, 0, sizeof(file->fd_stats));
 
 	switch(mode[0]) {
 		case 'r':
@@ -125,7 +331,6 @@ FSU_FILE
 			break;
 		case 'a':
 			flags |= O_WRONLY | O_CREAT | O_APPEND;
-			file->fd_fpos = file->fd_last = sb.st_size;
 			break;
 
 	}
@@ -133,25 +338,358 @@ FSU_FILE
 	if (strchr(mode, '+') != NULL)
 		flags |= O_RDWR;
 
+	t0 = fsu_stats_clock();
 	rv = rump_sys_open(fname, flags, 0666 & mask);
+	fsu_stats_syscall(&file->fd_stats, t0);
 	if (rv == -1) {
 		free(file);
 		return NULL;
 	}
 	file->fd_fd = rv;
 	file->fd_mode = flags & O_WRONLY ? FSU_FILE_WRITE : FSU_FILE_READ;
+	if (flags & O_APPEND)
+		file->fd_mode |= FSU_FILE_APPEND;
+
+	t0 = fsu_stats_clock();
+	rv = rump_sys_fstat(file->fd_fd, &sb);
+	fsu_stats_syscall(&file->fd_stats, t0);
+	if (rv == -1)
+		goto err;
+
+#ifdef EFTYPE
+	if (strchr(mode, 'f') != NULL && !S_ISREG(sb.st_mode)) {
+		errno = EFTYPE;
+		goto err;
+	}
+#endif
+	if (mode[0] == 'a')
+		file->fd_fpos = file->fd_last = sb.st_size;
+
+	file->fd_bufsize = fsu_fbufsize(file, &sb);
+	file->fd_buf = malloc(file->fd_bufsize);
+	if (file->fd_buf == NULL)
+		goto err;
+	file->fd_freebuf = true;
+
+	/* streams only read or written are likely to be used sequentially */
+	if (file->fd_mode == FSU_FILE_READ)
+		fsu_freadahead(file, FSU_RADEPTH);
+	else if (file->fd_mode == FSU_FILE_WRITE)
+		fsu_fwritebehind(file, FSU_WBDEPTH);
+
 	return file;
+
+err:
+	saved_errno = errno;
+	rump_sys_close(file->fd_fd);
+	free(file);
+	errno = saved_errno;
+	return NULL;
+}
+
+/*
+ * Default buffering policy: a few blocks of the preferred I/O size of
+ * the file, or of its file system if larger, but no more than the file
+ * itself when it is only read.
+ */
+static size_t
+fsu_fbufsize(FSU_FILE *file, struct stat *sb)
+{
+	struct nbstatvfs svb;
+	size_t iosize, size;
+	uint64_t t0;
+	int rv;
+
+	iosize = sb->st_blksize;
+	t0 = fsu_stats_clock();
+	rv = rump_sys_fstatvfs1(file->fd_fd, (struct statvfs *)&svb,
+	    RUMP_MNT_NOWAIT);
+	fsu_stats_syscall(&file->fd_stats, t0);
+	if (rv == 0 && svb.f_iosize > iosize)
+		iosize = svb.f_iosize;
+	file->fd_blksize = iosize;
+	if (iosize == 0)
+		return FSU_BUFSIZ;
+
+	size = iosize * FSU_BUFNBLK;
+	if (file->fd_mode == FSU_FILE_READ && S_ISREG(sb->st_mode) &&
+	    (off_t)size > sb->st_size)
+		size = (sb->st_size + iosize - 1) / iosize * iosize;
+
+	if (size < FSU_BUFSIZ)
+		size = FSU_BUFSIZ;
+	else if (size > FSU_BUFSIZ_DEFMAX)
+		size = FSU_BUFSIZ_DEFMAX;
+	return size;
 }
 
 void
+fsu_fstats(FSU_FILE *file, struct fsu_iostats *st)
+{
+
+	assert(file != NULL && st != NULL);
+
+	*st = file->fd_stats;
+}
+
+static ssize_t
+fsu_fsys_pread(FSU_FILE *file, void *buf, size_t len, off_t off)
+{
+	ssize_t rv;
+	uint64_t t0;
+
+	t0 = fsu_stats_clock();
+	rv = rump_sys_pread(file->fd_fd, buf, len, off);
+	fsu_stats_syscall(&file->fd_stats, t0);
+	if (rv > 0)
+		file->fd_stats.ios_bread += rv;
+	return rv;
+}
+
+static ssize_t
+fsu_fsys_pwrite(FSU_FILE *file, const void *buf, size_t len, off_t off)
+{
+	ssize_t rv;
+	uint64_t t0;
+
+	t0 = fsu_stats_clock();
+	rv = rump_sys_pwrite(file->fd_fd, buf, len, off);
+	fsu_stats_syscall(&file->fd_stats, t0);
+	if (rv > 0)
+		file->fd_stats.ios_bwritten += rv;
+	return rv;
+}
+
+/*
+ * Changes the buffer of a stream.  A NULL buf lets the library allocate
+ * it, a zero size selects the default policy of fsu_fopen.  Unlike
+ * setvbuf(3) it may be called at any time, the buffered data are written
+ * back or dropped and the next access refills the buffer from the
+ * current position.
+ */
+int
+fsu_setvbuf(FSU_FILE *file, char *buf, int mode, size_t size)
+{
+	struct stat sb;
+	uint8_t *nbuf;
+	uint64_t t0;
+	int nblocks, rdepth, wdepth, rv;
+
+	assert(file != NULL);
+
+	switch (mode) {
+	case _IONBF:
+		buf = NULL;
+		size = 1;
+		break;
+	case _IOFBF:
+		break;
+	default:
+		/* there is no line buffering, the streams hold no terminal */
+		errno = EINVAL;
+		return -1;
+	}
+
+	if (size == 0) {
+		if (buf != NULL) {
+			errno = EINVAL;
+			return -1;
+		}
+		t0 = fsu_stats_clock();
+		rv = rump_sys_fstat(file->fd_fd, &sb);
+		fsu_stats_syscall(&file->fd_stats, t0);
+		if (rv == -1)
+			return -1;
+		size = fsu_fbufsize(file, &sb);
+	}
+	if (size > FSU_BUFSIZ_MAX) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	if ((file->fd_dirty || file->fd_wb != NULL) && fsu_fflush(file) != 0)
+		return -1;
+
+	if (buf == NULL) {
+		nbuf = malloc(size);
+		if (nbuf == NULL)
+			return -1;
+	} else
+		nbuf = (uint8_t *)buf;
+
+	nblocks = file->fd_cache != NULL ? file->fd_cache->fc_nblocks : 0;
+	rdepth = file->fd_ra != NULL ? file->fd_ra->fr_depth : 0;
+	wdepth = file->fd_wb != NULL ? file->fd_wb->fr_depth : 0;
+	fsu_fc_free(file);
+	fsu_ra_free(file);
+	fsu_wb_free(file);
+
+	if (file->fd_freebuf)
+		free(file->fd_buf);
+	file->fd_buf = nbuf;
+	file->fd_bufsize = size;
+	file->fd_freebuf = buf == NULL;
+
+	file->fd_bpos = 0;
+	file->fd_last = file->fd_fpos;
+	file->fd_eof = false;
+
+	if (nblocks != 0)
+		fsu_fcache(file, nblocks);
+
+	/* the background I/O swaps buffers, it is not done with the caller's */
+	if (rdepth != 0 && file->fd_freebuf)
+		fsu_freadahead(file, rdepth);
+	if (wdepth != 0 && file->fd_freebuf)
+		fsu_fwritebehind(file, wdepth);
+	return 0;
+}
+
+/*
+ * Sets the number of buffers read ahead in the background once the
+ * stream is read sequentially, 0 disables read-ahead.  Only streams
+ * opened for reading and using a buffer allocated by the library can
+ * read ahead.  The buffers are allocated on the first sequential refill.
+ */
+int
+fsu_freadahead(FSU_FILE *file, int depth)
+{
+	struct fsu_fring *ra;
+
+	assert(file != NULL);
+
+	if (depth < 0 || depth > FSU_RADEPTH_MAX ||
+	    (depth > 0 && ((file->fd_mode & FSU_FILE_WRITE) != 0 ||
+		!file->fd_freebuf || file->fd_cache != NULL))) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	fsu_ra_free(file);
+	if (depth == 0)
+		return 0;
+
+	/* the buffers wait for the stream to be read sequentially */
+	ra = fsu_fring_alloc(0, depth);
+	if (ra == NULL)
+		return -1;
+	ra->fr_expect = file->fd_last;
+	file->fd_ra = ra;
+	return 0;
+}
+
+/*
+ * Sets the number of full buffers written back in the background while
+ * the next one is filled, 0 makes them written before fsu_fwrite() or
+ * fsu_fputc() returns.  Only streams opened for writing only, but not
+ * for appending, and using a buffer allocated by the library can write
+ * behind.  Errors of the background writes are reported by the next
+ * fsu_fwrite(), fsu_fputc(), fsu_fflush() or fsu_fclose().
+ */
+int
+fsu_fwritebehind(FSU_FILE *file, int depth)
+{
+
+	assert(file != NULL);
+
+	if (depth < 0 || depth > FSU_WBDEPTH_MAX ||
+	    (depth > 0 && (file->fd_mode != FSU_FILE_WRITE ||
+		!file->fd_freebuf))) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	fsu_wb_free(file);
+	if (depth == 0)
+		return 0;
+
+	file->fd_wb = fsu_fring_alloc(file->fd_bufsize, depth);
+	return file->fd_wb == NULL ? -1 : 0;
+}
+
+/*
+ * Keeps up to nblocks blocks of the file, of the size of the buffer and
+ * aligned on it, from which the buffer is refilled.  The least recently
+ * used block is replaced on a miss.  0 or 1 restores the single buffer.
+ * Only streams opened for reading only can cache blocks, read-ahead is
+ * disabled.
+ */
+int
+fsu_fcache(FSU_FILE *file, int nblocks)
+{
+	struct fsu_fcache *fc;
+	size_t size;
+	int i;
+
+	assert(file != NULL);
+
+	if (nblocks < 0 || nblocks > FSU_FCACHE_MAX ||
+	    (nblocks > 1 && file->fd_mode != FSU_FILE_READ)) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	fsu_fc_free(file);
+	if (nblocks <= 1)
+		return 0;
+
+	size = sizeof(struct fsu_fcache) +
+	    (nblocks - 1) * sizeof(struct fsu_fblock);
+	fc = malloc(size);
+	if (fc == NULL)
+		return -1;
+	memset(fc, 0, size);
+
+	for (i = 0; i < nblocks; ++i) {
+		fc->fc_blocks[i].fb_off = -1;
+		fc->fc_blocks[i].fb_buf = malloc(file->fd_bufsize);
+		if (fc->fc_blocks[i].fb_buf == NULL) {
+			while (--i >= 0)
+				free(fc->fc_blocks[i].fb_buf);
+			free(fc);
+			return -1;
+		}
+	}
+	fc->fc_nblocks = nblocks;
+	fc->fc_buf = file->fd_buf;
+
+	fsu_freadahead(file, 0);
+	file->fd_cache = fc;
+	return 0;
+}
+
+int
 fsu_fclose(FSU_FILE *file)
 {
+	uint64_t t0;
+	int rv, saved_errno;
 
 	assert(file != NULL);
 
-	fsu_fflush(file);
-	rump_sys_close(file->fd_fd);
+	rv = 0;
+	saved_errno = 0;
+	if ((file->fd_mode & FSU_FILE_WRITE) != 0 && fsu_fflush(file) != 0) {
+		rv = EOF;
+		saved_errno = errno;
+	}
+	fsu_fc_free(file);
+	fsu_ra_free(file);
+	fsu_wb_free(file);
+	t0 = fsu_stats_clock();
+	if (rump_sys_close(file->fd_fd) == -1 && rv == 0) {
+		rv = EOF;
+		saved_errno = errno;
+	}
+	fsu_stats_syscall(&file->fd_stats, t0);
+	fsu_stats_fclosed(&file->fd_stats);
+	if (file->fd_freebuf)
+		free(file->fd_buf);
+	free(file->fd_lbuf);
 	free(file);
+
+	if (rv != 0)
+		errno = saved_errno;
+	return rv;
 }
 
 void
@@ -161,10 +699,12 @@ fsu_rewind(FSU_FILE *file)
 	assert(file != NULL);
 
 	fsu_fflush(file);
+	++file->fd_stats.ios_seeks;
 
 	file->fd_fpos = file->fd_bpos = file->fd_last = 0;
 
-	fsu_fill_buffer(file);
+	if ((file->fd_mode & FSU_FILE_READ) != 0)
+		fsu_fill_buffer(file);
 }
 
 bool
@@ -198,13 +738,13 @@ fsu_ferror(FSU_FILE *file)
 size_t
 fsu_fwrite(void *ptr, size_t size, size_t nmemb, FSU_FILE *file)
 {
-	int rv;
-	ssize_t rsize;
+	ssize_t rv;
+	size_t n, resid;
 	unsigned char *p;
 
 	assert(file != NULL);
 
-	if ((rsize = size * nmemb) == 0)
+	if ((resid = size * nmemb) == 0)
 		return 0;
 
 	if ((file->fd_mode & FSU_FILE_WRITE) == 0) {
@@ -216,47 +756,59 @@ fsu_fwrite(void *ptr, size_t size, size_t nmemb, FSU_FILE *file)
 		return 0;
 
 	p = ptr;
-	if (rsize > (ssize_t)(sizeof(file->fd_buf) - file->fd_bpos)) {
-
-		fsu_fflush(file);
-
-		while (rsize > (ssize_t)sizeof(file->fd_buf)) {
-			rv = rump_sys_pwrite(file->fd_fd, p, sizeof(file->fd_buf), file->fd_fpos);
-			if (rv == -1) {
-				file->fd_err = errno;
-				return 0;
+	while (resid > 0) {
+		/*
+		 * Whole blocks that fill the empty buffer are not copied, nor
+		 * is what fills a buffer smaller than a block (unbuffered).
+		 */
+		if (file->fd_bpos == 0 && resid >= file->fd_bufsize &&
+		    (file->fd_blksize == 0 ||
+			file->fd_bufsize < file->fd_blksize ||
+			file->fd_fpos % file->fd_blksize == 0)) {
+			n = resid;
+			if (file->fd_blksize != 0 && n >= file->fd_blksize)
+				n -= n % file->fd_blksize;
+			rv = fsu_fsys_pwrite(file, p, n, file->fd_fpos);
+			if (rv <= 0) {
+				file->fd_err = rv == -1 ? errno : EIO;
+				break;
 			}
 			p += rv;
-			rsize -= rv;
+			resid -= rv;
 			file->fd_fpos += rv;
-		}
-		rv = rump_sys_pwrite(file->fd_fd, p, rsize, file->fd_fpos);
-		if (rv == -1) {
-			file->fd_err = errno;
-			return 0;
+			file->fd_last = file->fd_fpos;
+			continue;
 		}
 
-		file->fd_fpos += rv;
-
-		if (rv == rsize) {
+		if ((n = fsu_fwroom(file)) == 0) {
+			if (fsu_wb_push(file) == -1)
+				break;
+			continue;
+		}
+		if (n > resid)
+			n = resid;
+		memcpy(file->fd_buf + file->fd_bpos, p, n);
+		p += n;
+		resid -= n;
+		file->fd_bpos += n;
+		file->fd_fpos += n;
+		if (file->fd_fpos > file->fd_last)
 			file->fd_last = file->fd_fpos;
-			fsu_fill_buffer(file);
-		} else
-			nmemb = (rsize - rv) / size;
-	} else {
-		memcpy(file->fd_buf + file->fd_bpos, ptr, rsize);
-		file->fd_fpos += rsize;
-		file->fd_bpos += rsize;
 		file->fd_dirty = true;
 	}
 
-	return nmemb;
+	return (size * nmemb - resid) / size;
 }
 
+/*
+ * Writes the buffered data back, waits for the buffers written behind
+ * and reports the first error met by any of these writes.  The buffer
+ * is left empty at the current position.
+ */
 int
 fsu_fflush(FSU_FILE *file)
 {
-	int rv;
+	ssize_t rv;
 
 	assert(file != NULL);
 
@@ -266,12 +818,23 @@ fsu_fflush(FSU_FILE *file)
 	}
 
 	if (file->fd_dirty) {
-		rv = rump_sys_pwrite(file->fd_fd, file->fd_buf,
-				file->fd_bpos,
-				file->fd_fpos - file->fd_bpos);
-		if (rv == -1 || rv != (int)file->fd_bpos)
+		++file->fd_stats.ios_flushes;
+		rv = fsu_fsys_pwrite(file, file->fd_buf, file->fd_bpos,
+		    file->fd_fpos - file->fd_bpos);
+		if (rv == -1)
 			file->fd_err = errno;
+		else if (rv != (ssize_t)file->fd_bpos)
+			file->fd_err = EIO;
 		file->fd_dirty = false;
+		file->fd_bpos = 0;
+		file->fd_last = file->fd_fpos;
+	}
+	if (file->fd_wb != NULL)
+		fsu_wb_drain(file);
+
+	if (file->fd_err != 0) {
+		errno = file->fd_err;
+		return EOF;
 	}
 	return 0;
 }
@@ -283,35 +846,60 @@ fsu_fseek(FSU_FILE *file, long off, int whence)
 	return fsu_fseeko(file, (off_t)off, whence);
 }
 
+/*
+ * Only SEEK_END has to ask the file system, the buffer is kept if it
+ * holds the new position and refilled by the next read otherwise.
+ */
 int
 fsu_fseeko(FSU_FILE *file, off_t off, int whence)
 {
 	struct stat sb;
+	off_t pos, start;
+	uint64_t t0;
+	int rv;
 
-	fsu_fflush(file);
+	assert(file != NULL);
+
+	++file->fd_stats.ios_seeks;
+	if ((file->fd_mode & FSU_FILE_WRITE) != 0 && fsu_fflush(file) != 0)
+		return -1;
 	fsu_clearerr(file);
-	rump_sys_fstat(file->fd_fd, &sb);
 
 	switch (whence) {
 	case SEEK_CUR:
-		file->fd_fpos += off;
+		pos = file->fd_fpos + off;
 		break;
 	case SEEK_SET:
-		file->fd_fpos = off;
+		pos = off;
 		break;
 	case SEEK_END:
-		file->fd_fpos = sb.st_size + off;
+		t0 = fsu_stats_clock();
+		rv = rump_sys_fstat(file->fd_fd, &sb);
+		fsu_stats_syscall(&file->fd_stats, t0);
+		if (rv == -1)
+			return -1;
+		pos = sb.st_size + off;
 		break;
 	default:
 		errno = EINVAL;
 		return -1;
 		/* NOTREACHED */
 	}
-	if (file->fd_fpos >= (size_t)sb.st_size) {
-		file->fd_last = file->fd_fpos;
+	if (pos < 0) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	start = file->fd_fpos - file->fd_bpos;
+	if ((file->fd_mode & FSU_FILE_READ) != 0 &&
+	    pos >= start && pos < (off_t)file->fd_last)
+		file->fd_bpos = pos - start;
+	else {
 		file->fd_bpos = 0;
-	} else
-		fsu_fill_buffer(file);
+		file->fd_last = pos;
+	}
+	file->fd_fpos = pos;
+	file->fd_eof = false;
 	return 0;
 }
 
@@ -329,26 +917,576 @@ fsu_ftello(FSU_FILE *file)
 	return (off_t)file->fd_fpos;
 }
 
+ssize_t
+fsu_pread(FSU_FILE *file, void *buf, size_t nbytes, off_t off)
+{
+	struct iovec iov;
+
+	iov.iov_base = buf;
+	iov.iov_len = nbytes;
+	return fsu_preadv(file, &iov, 1, off);
+}
+
+ssize_t
+fsu_pwrite(FSU_FILE *file, const void *buf, size_t nbytes, off_t off)
+{
+	struct iovec iov;
+
+	iov.iov_base = __UNCONST(buf);
+	iov.iov_len = nbytes;
+	return fsu_pwritev(file, &iov, 1, off);
+}
+
+/*
+ * Reads at off without moving the stream position.  Requests the buffer
+ * holds entirely are copied from it, otherwise what is still to be
+ * written there is flushed first.
+ */
+ssize_t
+fsu_preadv(FSU_FILE *file, const struct iovec *iov, int iovcnt, off_t off)
+{
+	ssize_t rv;
+	size_t len, n;
+	off_t start;
+	uint64_t t0;
+	uint8_t *p;
+	int i;
+
+	assert(file != NULL);
+
+	if ((file->fd_mode & FSU_FILE_READ) == 0) {
+		errno = EBADF;
+		return -1;
+	}
+
+	if (fsu_fiovlen(iov, iovcnt, &len) == -1)
+		return -1;
+
+	/* the buffer holds the file from start to fd_last, if not empty */
+	start = file->fd_fpos - file->fd_bpos;
+	if ((off_t)file->fd_last > start && off >= start &&
+	    off + (off_t)len <= (off_t)file->fd_last) {
+		p = file->fd_buf + (off - start);
+		for (i = 0; i < iovcnt; ++i) {
+			n = iov[i].iov_len;
+			memcpy(iov[i].iov_base, p, n);
+			p += n;
+		}
+		return len;
+	}
+
+	if (fsu_fwoverlap(file, off, len) && fsu_fflush(file) != 0)
+		return -1;
+
+	t0 = fsu_stats_clock();
+	rv = rump_sys_preadv(file->fd_fd, iov, iovcnt, off);
+	fsu_stats_syscall(&file->fd_stats, t0);
+	if (rv > 0)
+		file->fd_stats.ios_bread += rv;
+	return rv;
+}
+
+/*
+ * Writes at off without moving the stream position.  A buffer
+ * overlapping the request is written back first if needed and dropped.
+ */
+ssize_t
+fsu_pwritev(FSU_FILE *file, const struct iovec *iov, int iovcnt, off_t off)
+{
+	ssize_t rv;
+	size_t len;
+	off_t start;
+	uint64_t t0;
+	bool drop;
+
+	assert(file != NULL);
+
+	if ((file->fd_mode & FSU_FILE_WRITE) == 0) {
+		errno = EBADF;
+		return -1;
+	}
+
+	if (fsu_fiovlen(iov, iovcnt, &len) == -1)
+		return -1;
+
+	start = file->fd_fpos - file->fd_bpos;
+	drop = off < (off_t)file->fd_last && off + (off_t)len > start;
+	if (((drop && file->fd_dirty) || fsu_fwoverlap(file, off, len)) &&
+	    fsu_fflush(file) != 0)
+		return -1;
+
+	t0 = fsu_stats_clock();
+	rv = rump_sys_pwritev(file->fd_fd, iov, iovcnt, off);
+	fsu_stats_syscall(&file->fd_stats, t0);
+	if (rv > 0)
+		file->fd_stats.ios_bwritten += rv;
+	if (rv > 0 && drop) {
+		file->fd_bpos = 0;
+		file->fd_last = file->fd_fpos;
+	}
+	return rv;
+}
+
+/* Sums the lengths of an I/O vector, which must fit in a ssize_t */
+static int
+fsu_fiovlen(const struct iovec *iov, int iovcnt, size_t *lenp)
+{
+	size_t len;
+	int i;
+
+	if (iovcnt <= 0 || iovcnt > IOV_MAX) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	for (len = 0, i = 0; i < iovcnt; ++i) {
+		if (iov[i].iov_len > SSIZE_MAX - len) {
+			errno = EINVAL;
+			return -1;
+		}
+		len += iov[i].iov_len;
+	}
+	*lenp = len;
+	return 0;
+}
+
+/*
+ * Tells whether data not written yet, in the buffer or behind, overlap
+ * len bytes at off.
+ */
+static bool
+fsu_fwoverlap(FSU_FILE *file, off_t off, size_t len)
+{
+	struct fsu_fring *wb;
+	struct fsu_ioreq *req;
+	off_t end;
+	int i;
+
+	end = off + len;
+	if (file->fd_dirty && off < (off_t)file->fd_fpos &&
+	    end > (off_t)(file->fd_fpos - file->fd_bpos))
+		return true;
+
+	if ((wb = file->fd_wb) == NULL)
+		return false;
+	for (i = 0; i < wb->fr_count; ++i) {
+		req = &wb->fr_req[(wb->fr_head + i) % wb->fr_depth];
+		if (off < req->ior_off + (off_t)req->ior_len &&
+		    end > req->ior_off)
+			return true;
+	}
+	return false;
+}
+
 static void
 fsu_fill_buffer(FSU_FILE *file)
 {
-	int rv;
+	ssize_t rv;
 
 	assert(file != NULL);
 
 	fsu_fflush(file);
+	++file->fd_stats.ios_fills;
 
-	rv = rump_sys_read(file->fd_fd, file->fd_buf, sizeof(file->fd_buf));
+	if (file->fd_cache != NULL) {
+		fsu_fc_fill(file);
+		return;
+	}
+
+	if (file->fd_ra != NULL && fsu_ra_fill(file))
+		return;
+
+	rv = fsu_fsys_pread(file, file->fd_buf, file->fd_bufsize,
+	    file->fd_fpos);
 
 	if (rv == -1) {
 		file->fd_err = errno;
   		file->fd_eof = true;
 		return;
-	} else if (rv < (int)sizeof(file->fd_buf))
-		file->fd_eof = true;
+	}
+	file->fd_eof = (size_t)rv < file->fd_bufsize;
 
 	file->fd_last = file->fd_fpos + rv;
 	file->fd_bpos = 0;
+
+	if (file->fd_ra != NULL && !file->fd_eof)
+		fsu_ra_start(file);
+}
+
+/* Makes the cached block holding the current position the buffer */
+static void
+fsu_fc_fill(FSU_FILE *file)
+{
+	struct fsu_fcache *fc;
+	struct fsu_fblock *fb, *lru;
+	ssize_t rv;
+	off_t off;
+	int i;
+
+	fc = file->fd_cache;
+	off = file->fd_fpos - file->fd_fpos % file->fd_bufsize;
+
+	fb = lru = NULL;
+	for (i = 0; i < fc->fc_nblocks; ++i) {
+		if (fc->fc_blocks[i].fb_off == off) {
+			fb = &fc->fc_blocks[i];
+			break;
+		}
+		if (lru == NULL || fc->fc_blocks[i].fb_used < lru->fb_used)
+			lru = &fc->fc_blocks[i];
+	}
+
+	if (fb != NULL)
+		++file->fd_stats.ios_cachehits;
+	else {
+		++file->fd_stats.ios_cachemisses;
+		fb = lru;
+		fb->fb_off = -1;
+		rv = fsu_fsys_pread(file, fb->fb_buf, file->fd_bufsize, off);
+		if (rv == -1) {
+			file->fd_err = errno;
+			file->fd_eof = true;
+			return;
+		}
+		fb->fb_off = off;
+		fb->fb_len = rv;
+	}
+	fb->fb_used = ++fc->fc_clock;
+
+	file->fd_buf = fb->fb_buf;
+	file->fd_eof = fb->fb_len < file->fd_bufsize;
+	if ((size_t)(file->fd_fpos - off) < fb->fb_len) {
+		file->fd_bpos = file->fd_fpos - off;
+		file->fd_last = off + fb->fb_len;
+	} else {
+		file->fd_bpos = 0;
+		file->fd_last = file->fd_fpos;
+	}
+}
+
+/* Drops the cached blocks and gives the stream its own buffer back */
+static void
+fsu_fc_free(FSU_FILE *file)
+{
+	struct fsu_fcache *fc;
+	int i;
+
+	if ((fc = file->fd_cache) == NULL)
+		return;
+
+	file->fd_buf = fc->fc_buf;
+	file->fd_bpos = 0;
+	file->fd_last = file->fd_fpos;
+	file->fd_eof = false;
+
+	for (i = 0; i < fc->fc_nblocks; ++i)
+		free(fc->fc_blocks[i].fb_buf);
+	free(fc);
+	file->fd_cache = NULL;
+}
+
+/*
+ * Refills the buffer with the oldest read-ahead buffer if it holds the
+ * data at the current position, the buffers are swapped.
+ * Otherwise the read-ahead is dropped and false is returned.
+ */
+static bool
+fsu_ra_fill(FSU_FILE *file)
+{
+	struct fsu_fring *ra;
+	struct fsu_ioreq *req;
+	uint8_t *buf;
+
+	ra = file->fd_ra;
+	if ((off_t)file->fd_fpos == ra->fr_expect)
+		++ra->fr_seq;
+	else
+		ra->fr_seq = 0;
+
+	if (ra->fr_count == 0)
+		return false;
+
+	req = &ra->fr_req[ra->fr_head];
+	if (req->ior_off != (off_t)file->fd_fpos) {
+		fsu_ra_drain(file);
+		return false;
+	}
+
+	if (fsu_io_wait(req))
+		++file->fd_stats.ios_rastalls;
+	++file->fd_stats.ios_rafills;
+	fsu_stats_ioreq(&file->fd_stats, req);
+	ra->fr_head = (ra->fr_head + 1) % ra->fr_depth;
+	--ra->fr_count;
+
+	if (req->ior_rv == -1) {
+		file->fd_err = req->ior_errno;
+		file->fd_eof = true;
+		fsu_ra_drain(file);
+		return true;
+	}
+
+	buf = file->fd_buf;
+	file->fd_buf = req->ior_buf;
+	req->ior_buf = buf;
+
+	file->fd_eof = (size_t)req->ior_rv < file->fd_bufsize;
+	file->fd_last = file->fd_fpos + req->ior_rv;
+	file->fd_bpos = 0;
+
+	if (file->fd_eof)
+		fsu_ra_drain(file);
+	else
+		fsu_ra_start(file);
+	return true;
+}
+
+/* Keeps every read-ahead buffer in flight once reading is sequential */
+static void
+fsu_ra_start(FSU_FILE *file)
+{
+	struct fsu_fring *ra;
+	struct fsu_ioreq *req;
+
+	ra = file->fd_ra;
+	ra->fr_expect = file->fd_last;
+	if (ra->fr_seq < FSU_RASEQ)
+		return;
+
+	if (ra->fr_req[0].ior_buf == NULL &&
+	    !fsu_fring_bufs(ra, file->fd_bufsize))
+		return;
+
+	if (ra->fr_count == 0)
+		ra->fr_next = file->fd_last;
+
+	while (ra->fr_count < ra->fr_depth) {
+		req = &ra->fr_req[(ra->fr_head + ra->fr_count) % ra->fr_depth];
+		req->ior_op = FSU_IO_READ;
+		req->ior_fd = file->fd_fd;
+		req->ior_len = file->fd_bufsize;
+		req->ior_off = ra->fr_next;
+		fsu_io_submit(req);
+
+		ra->fr_next += file->fd_bufsize;
+		++ra->fr_count;
+	}
+}
+
+/* Waits for the buffers in flight and forgets about them */
+static void
+fsu_ra_drain(FSU_FILE *file)
+{
+	struct fsu_fring *ra;
+
+	ra = file->fd_ra;
+	while (ra->fr_count > 0) {
+		fsu_io_wait(&ra->fr_req[ra->fr_head]);
+		fsu_stats_ioreq(&file->fd_stats, &ra->fr_req[ra->fr_head]);
+		ra->fr_head = (ra->fr_head + 1) % ra->fr_depth;
+		--ra->fr_count;
+	}
+	ra->fr_head = 0;
+}
+
+static void
+fsu_ra_free(FSU_FILE *file)
+{
+
+	if (file->fd_ra == NULL)
+		return;
+
+	fsu_ra_drain(file);
+	fsu_fring_free(file->fd_ra);
+	file->fd_ra = NULL;
+}
+
+/*
+ * Room left in the buffer.  The buffer ends on the last block boundary
+ * of the file it can reach so that once a buffer has been written back
+ * the next ones are block aligned.
+ */
+static size_t
+fsu_fwroom(FSU_FILE *file)
+{
+	size_t end;
+
+	end = file->fd_fpos - file->fd_bpos + file->fd_bufsize;
+	if (file->fd_blksize != 0 && file->fd_bufsize > file->fd_blksize)
+		end -= end % file->fd_blksize;
+	return end > file->fd_fpos ? end - file->fd_fpos : 0;
+}
+
+/*
+ * Writes the buffer back and goes on with an empty buffer at the current
+ * position.  With write-behind the buffer is handed to the I/O threads
+ * and swapped with a free one, the oldest buffer in flight is waited
+ * for if there is none.
+ */
+static int
+fsu_wb_push(FSU_FILE *file)
+{
+	struct fsu_fring *wb;
+	struct fsu_ioreq *req;
+	uint8_t *buf;
+
+	wb = file->fd_wb;
+	if (file->fd_dirty && wb == NULL)
+		return fsu_fflush(file) == 0 ? 0 : -1;
+
+	if (file->fd_dirty) {
+		if (wb->fr_count == wb->fr_depth && fsu_wb_wait(file))
+			++file->fd_stats.ios_wbstalls;
+
+		req = &wb->fr_req[(wb->fr_head + wb->fr_count) % wb->fr_depth];
+		buf = req->ior_buf;
+		req->ior_buf = file->fd_buf;
+		file->fd_buf = buf;
+
+		req->ior_op = FSU_IO_WRITE;
+		req->ior_fd = file->fd_fd;
+		req->ior_len = file->fd_bpos;
+		req->ior_off = file->fd_fpos - file->fd_bpos;
+		fsu_io_submit(req);
+
+		++wb->fr_count;
+		++file->fd_stats.ios_flushes;
+		++file->fd_stats.ios_wbflushes;
+		file->fd_dirty = false;
+	}
+	file->fd_bpos = 0;
+	file->fd_last = file->fd_fpos;
+
+	return file->fd_err != 0 ? -1 : 0;
+}
+
+/*
+ * Waits for the oldest buffer written behind and keeps the first error.
+ * Returns true if the write was still in progress.
+ */
+static bool
+fsu_wb_wait(FSU_FILE *file)
+{
+	struct fsu_fring *wb;
+	struct fsu_ioreq *req;
+	bool waited;
+
+	wb = file->fd_wb;
+	req = &wb->fr_req[wb->fr_head];
+	waited = fsu_io_wait(req);
+	fsu_stats_ioreq(&file->fd_stats, req);
+	wb->fr_head = (wb->fr_head + 1) % wb->fr_depth;
+	--wb->fr_count;
+
+	if (req->ior_rv != (ssize_t)req->ior_len && file->fd_err == 0)
+		file->fd_err = req->ior_rv == -1 ? req->ior_errno : EIO;
+	return waited;
+}
+
+static void
+fsu_wb_drain(FSU_FILE *file)
+{
+
+	while (file->fd_wb->fr_count > 0)
+		fsu_wb_wait(file);
+	file->fd_wb->fr_head = 0;
+}
+
+static void
+fsu_wb_free(FSU_FILE *file)
+{
+
+	if (file->fd_wb == NULL)
+		return;
+
+	fsu_wb_drain(file);
+	fsu_fring_free(file->fd_wb);
+	file->fd_wb = NULL;
+}
+
+/*
+ * Allocates depth idle requests, each with a buffer of bufsize bytes.
+ * With a bufsize of 0 the buffers are left to fsu_fring_bufs().
+ */
+static struct fsu_fring *
+fsu_fring_alloc(size_t bufsize, int depth)
+{
+	struct fsu_fring *fr;
+	size_t size;
+
+	size = sizeof(struct fsu_fring) + (depth - 1) * sizeof(struct fsu_ioreq);
+	fr = malloc(size);
+	if (fr == NULL)
+		return NULL;
+	memset(fr, 0, size);
+	fr->fr_depth = depth;
+
+	if (bufsize != 0 && !fsu_fring_bufs(fr, bufsize)) {
+		free(fr);
+		return NULL;
+	}
+	return fr;
+}
+
+/* Gives each request of a ring a buffer of bufsize bytes */
+static bool
+fsu_fring_bufs(struct fsu_fring *fr, size_t bufsize)
+{
+	int i;
+
+	for (i = 0; i < fr->fr_depth; ++i) {
+		fr->fr_req[i].ior_buf = malloc(bufsize);
+		if (fr->fr_req[i].ior_buf == NULL) {
+			while (--i >= 0) {
+				free(fr->fr_req[i].ior_buf);
+				fr->fr_req[i].ior_buf = NULL;
+			}
+			return false;
+		}
+	}
+	return true;
+}
+
+/* Frees a ring with no buffer in flight */
+static void
+fsu_fring_free(struct fsu_fring *fr)
+{
+	int i;
+
+	for (i = 0; i < fr->fr_depth; ++i)
+		free(fr->fr_req[i].ior_buf);
+	free(fr);
+}
+
+/*
+ * Reads resid bytes at the current position straight into the caller's
+ * memory, the buffer must have been consumed.  The buffer is left empty
+ * at the new position.  Returns the number of bytes which were not read.
+ */
+static size_t
+fsu_fread_direct(FSU_FILE *file, char *p, size_t resid)
+{
+	ssize_t rv;
+
+	if (file->fd_ra != NULL)
+		fsu_ra_drain(file);
+
+	while (resid > 0) {
+		rv = fsu_fsys_pread(file, p, resid, file->fd_fpos);
+		if (rv == -1)
+			file->fd_err = errno;
+		if (rv <= 0) {
+			file->fd_eof = true;
+			break;
+		}
+		file->fd_fpos += rv;
+		p += rv;
+		resid -= rv;
+	}
+
+	file->fd_last = file->fd_fpos;
+	file->fd_bpos = 0;
+	return resid;
 }
 
 /* from src/lib/libc/stdio/fread.c */
@@ -406,13 +1544,19 @@ fsu_fread(void *ptr, size_t size, size_t count, FSU_FILE *file)
 	while (resid > (size_t)(r = file->fd_last - file->fd_fpos)) {
 		memcpy(p, file->fd_buf + file->fd_bpos, r);
 
+		/* the buffer may be kept, fd_bpos follows fd_fpos */
 		file->fd_fpos += r;
+		file->fd_bpos += r;
 		p += r;
 		resid -= r;
 
 		if (file->fd_eof)
 			return ((total - resid) / size);
 
+		/* don't copy what does not fit in the buffer */
+		if (resid > file->fd_bufsize)
+			return ((total - fsu_fread_direct(file, p, resid)) / size);
+
 		fsu_fill_buffer(file);
 	}
 	memcpy(p, file->fd_buf + file->fd_bpos, resid);
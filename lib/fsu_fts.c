@@ -65,31 +65,47 @@ __RCSID("$NetBSD: fsu_fts.c,v 1.3 2009/11/05 14:02:43 stacktic Exp $");
 #include <stdio.h>
 
 #include <rump/rump_syscalls.h>
+#include <rump/rumpdefs.h>
 
 #include <fsu_utils.h>
 #include <fsu_fts.h>
 
+#include "fsu_stats.h"
+
 #ifndef _DIAGASSERT
 #define _DIAGASSERT(x)
 #endif
 
 static FSU_FTSENT	*fsu_fts_alloc(FSU_FTS *, const char *, size_t);
+static void	*fsu_fts_amalloc(struct fsu_fts_arena *, size_t);
+static void	 fsu_fts_adestroy(struct fsu_fts_arena *);
+static int	 fsu_fts_ancadd(FSU_FTS *, FSU_FTSENT *);
+static void	 fsu_fts_ancdel(FSU_FTS *, const FSU_FTSENT *);
+static FSU_FTSENT	*fsu_fts_ancfind(FSU_FTS *, dev_t, __fsu_fts_ino_t);
 static FSU_FTSENT	*fsu_fts_build(FSU_FTS *, int);
+static FSU_DIR	*fsu_fts_dir(FSU_FTS *, const FSU_FTSENT *);
+static void	 fsu_fts_dirdrop(FSU_FTS *, const FSU_FTSENT *);
 static void	 fsu_fts_free(FSU_FTSENT *);
+static void	 fsu_fts_leave(FSU_FTS *, FSU_FTSENT *);
 static void	 fsu_fts_lfree(FSU_FTSENT *);
+static int	 fsu_fts_inocmp(const void *, const void *);
+static void	 fsu_fts_inostat(FSU_FTS *, FSU_FTSENT *, size_t, char *);
 static void	 fsu_fts_load(FSU_FTS *, FSU_FTSENT *);
 static size_t	 fsu_fts_maxarglen(char * const *);
 static size_t	 fsu_fts_pow2(size_t);
 static int	 fsu_fts_palloc(FSU_FTS *, size_t);
 static void	 fsu_fts_padjust(FSU_FTS *, FSU_FTSENT *);
+static FSU_FTSENT	*fsu_fts_keysort(FSU_FTS *, FSU_FTSENT *, size_t);
+static void	 fsu_fts_skload(struct fsu_fts_skey *, size_t, int, int,
+		    uint64_t);
+static int	 fsu_fts_skcmp(const struct fsu_fts_skey *,
+		    const struct fsu_fts_skey *, int, int, uint64_t);
+static void	 fsu_fts_skqsort(struct fsu_fts_skey *, size_t, int, int,
+		    uint64_t);
 static FSU_FTSENT	*fsu_fts_sort(FSU_FTS *, FSU_FTSENT *, size_t);
 static unsigned short fsu_fts_stat(FSU_FTS *, FSU_FTSENT *, int);
-
-#if defined(ALIGNBYTES) && defined(ALIGN)
-#define FTS_ALLOC_ALIGNED       1
-#else
-#undef  FTS_ALLOC_ALIGNED
-#endif
+static int	 fsu_fts_xstat(FSU_FTS *, FSU_FTSENT *, __fsu_fts_stat_t *,
+		    int);
 
 #define	ISDOT(a)	(a[0] == '.' && (!a[1] || (a[1] == '.' && !a[2])))
 
@@ -98,7 +114,107 @@ static unsigned short fsu_fts_stat(FSU_FTS *, FSU_FTSENT *, int);
 #define	SET(opt)	(sp->fts_options |= (opt))
 
 #define	CHDIR(sp, path)	(!ISSET(FTS_NOCHDIR) && \
-			 rump_sys_chdir(path))
+			 fsu_chdir(path))
+
+/* fsu_fts_build is done with a directory; with FTS_DIRFD it stays open. */
+#define	BCLOSEDIR(dirp)	do {					\
+	if (!ISSET(FTS_DIRFD))					\
+		fsu_closedir(dirp);				\
+} while (/*CONSTCOND*/0)
+
+/*
+ * Entries are carved out of chunks of FSU_FTS_CHUNK bytes, each one
+ * preceded by a pointer to its chunk.  A chunk counts its live entries
+ * and, once they are all freed, is reused as a whole: siblings are
+ * allocated together and freed soon after one another, so this happens
+ * all along a walk.  The chunks are freed with the FSU_FTS.
+ */
+#define	FSU_FTS_CHUNK	(64 * 1024)
+#define	FSU_FTS_ALIGN(n) (((n) + 15) & ~(size_t)15)
+#define	FSU_FTS_HDR	FSU_FTS_ALIGN(sizeof(struct fsu_fts_chunk *))
+
+struct fsu_fts_chunk {
+	struct fsu_fts_chunk *ch_next;	/* all the chunks of the arena */
+	struct fsu_fts_chunk *ch_free;	/* next chunk without live entry */
+	struct fsu_fts_arena *ch_arena;
+	size_t ch_used;			/* bytes carved out */
+	int ch_live;			/* entries not freed yet */
+};
+#define	FSU_FTS_CHUNKHDR FSU_FTS_ALIGN(sizeof(struct fsu_fts_chunk))
+
+struct fsu_fts_arena {
+	struct fsu_fts_chunk *fa_chunks; /* all of them */
+	struct fsu_fts_chunk *fa_cur;	/* being carved */
+	struct fsu_fts_chunk *fa_free;	/* without live entry */
+	struct fsu_ftsstats fa_stats;
+};
+
+/*
+ * With FTS_DIRFD, directories are opened relative to their parent and
+ * their entries stat'ed with fstatat(2), without chdir nor looking up
+ * whole paths.  The FSU_FTS_NDIRS directories used last stay open, those
+ * of the current path in general; one that was closed is opened again
+ * from its parent when needed.  A directory is closed after its
+ * post-order visit.
+ */
+#define	FSU_FTS_NDIRS	32
+
+struct fsu_fts_dirs {
+	struct fsu_fts_dirslot {
+		FSU_DIR *dc_dir;
+		const FSU_FTSENT *dc_ent;	/* node of the directory */
+		__fsu_fts_ino_t dc_ino;
+		uint64_t dc_used;		/* fd_clock when last used */
+	} fd_slots[FSU_FTS_NDIRS];
+	uint64_t fd_clock;
+};
+
+/*
+ * In logical walks, the directories being walked, those of the current
+ * path, are kept in an open addressing hash table on their device and
+ * inode to find cycles without going up the path.  A directory enters it
+ * when it is read and leaves it after its post-order visit.  Physical
+ * walks only meet cycles through hard links to directories, which are
+ * rare enough to be found by going up the path.
+ */
+#define	FSU_FTS_NANC	64		/* initial size, a power of 2 */
+
+struct fsu_fts_anc {
+	FSU_FTSENT **an_tab;
+	size_t an_size;
+	size_t an_count;
+};
+
+/*
+ * With fsu_fts_setsort, the entries below the root level are sorted on
+ * keys copied out of them, so that the sort does not go through the
+ * entries and their stat buffers at each comparison.  A key is a string
+ * of 64-bit "digits" compared as unsigned integers: up to two numbers,
+ * then the name, FSU_FTS_SKW bytes per digit.  The numbers are encoded
+ * so that their order is the one wanted, and the order is reversed by
+ * complementing all the digits.  Keys are put in order with a multikey
+ * quicksort, partitioning on one digit at a time.
+ */
+#define	FSU_FTS_SKW	8		/* name bytes per digit */
+#define	FSU_FTS_SKSMALL	12		/* insertion sort below this */
+
+/* a signed number as a digit, in ascending order */
+#define	FSU_FTS_SKNUM(x) ((uint64_t)(int64_t)(x) ^ ((uint64_t)1 << 63))
+
+#ifdef HAVE_STRUCT_STAT_ST_ATIMESPEC
+#define	FSU_FTS_NSEC(sbp, t)	((sbp)->st_##t##timespec.tv_nsec)
+#else
+#define	FSU_FTS_NSEC(sbp, t)	0
+#endif
+
+struct fsu_fts_skey {
+	uint64_t sk_digit;		/* digit at the current depth */
+	uint64_t sk_num[2];		/* numeric digits */
+	FSU_FTSENT *sk_ent;
+};
+
+/* directory entries read at once by fsu_fts_build */
+#define	FSU_FTS_NBATCH	128
 
 /* fsu_fts_build flags */
 #define	BCHILD		1		/* fsu_fts_children */
@@ -133,11 +249,21 @@ fsu_fts_open(char * const *argv, int options,
 	memset(sp, 0, sizeof(FSU_FTS));
 	sp->fts_compar = compar;
 	sp->fts_options = options;
+	if ((sp->fts_arena = calloc(1, sizeof(*sp->fts_arena))) == NULL)
+		goto mem1;
+	sp->fts_arena->fa_stats.fst_walks = 1;
 
 	/* Logical walks turn on NOCHDIR; symbolic links are too hard. */
 	if (ISSET(FTS_LOGICAL))
 		SET(FTS_NOCHDIR);
 
+	/* Descriptor-relative walks never chdir either. */
+	if (ISSET(FTS_DIRFD)) {
+		SET(FTS_NOCHDIR);
+		if ((sp->fts_dirs = calloc(1, sizeof(*sp->fts_dirs))) == NULL)
+			goto mem1;
+	}
+
 	/*
 	 * Start out with 1K of path space, and enough, in any case,
 	 * to hold the user's paths.
@@ -215,7 +341,10 @@ fsu_fts_open(char * const *argv, int options,
 mem3:	fsu_fts_lfree(root);
 	fsu_fts_free(parent);
 mem2:	free(sp->fts_path);
-mem1:	free(sp);
+mem1:	if (sp->fts_arena != NULL)
+		fsu_fts_adestroy(sp->fts_arena);
+	free(sp->fts_dirs);
+	free(sp);
 	return (NULL);
 }
 
@@ -250,7 +379,7 @@ int
 fsu_fts_close(FSU_FTS *sp)
 {
 	FSU_FTSENT *freep, *p;
-	int saved_errno = 0;
+	int i, saved_errno = 0;
 
 	_DIAGASSERT(sp != NULL);
 
@@ -275,15 +404,31 @@ fsu_fts_close(FSU_FTS *sp)
 		fsu_fts_lfree(sp->fts_child);
 	if (sp->fts_array)
 		free(sp->fts_array);
+	free(sp->fts_skeys);
 	free(sp->fts_path);
 
 	/* Return to original directory, save errno if necessary. */
 	if (!ISSET(FTS_NOCHDIR)) {
-		if (rump_sys_chdir(sp->fts_rpath) != 0)
+		if (fsu_chdir(sp->fts_rpath) != 0)
 			saved_errno = errno;
 	}
 
-	/* Free up the stream pointer. */
+	/* Close the directories still open. */
+	if (sp->fts_dirs != NULL) {
+		for (i = 0; i < FSU_FTS_NDIRS; i++)
+			if (sp->fts_dirs->fd_slots[i].dc_dir != NULL)
+				fsu_closedir(sp->fts_dirs->fd_slots[i].dc_dir);
+		free(sp->fts_dirs);
+	}
+
+	if (sp->fts_anc != NULL) {
+		free(sp->fts_anc->an_tab);
+		free(sp->fts_anc);
+	}
+
+	/* Free up the entries left, the stream pointer. */
+	fsu_fts_adestroy(sp->fts_arena);
+	free(sp->fts_rpath);
 	free(sp);
 	if (saved_errno) {
 		errno = saved_errno;
@@ -375,6 +520,7 @@ fsu_fts_read(FSU_FTS *sp)
 				fsu_fts_lfree(sp->fts_child);
 				sp->fts_child = NULL;
 			}
+			fsu_fts_leave(sp, p);
 			p->fts_info = FTS_DP;
 			return (p);
 		}
@@ -409,6 +555,7 @@ fsu_fts_read(FSU_FTS *sp)
 		} else if ((sp->fts_child = fsu_fts_build(sp, BREAD)) == NULL) {
 			if (ISSET(FTS_STOP))
 				return (NULL);
+			fsu_fts_leave(sp, p);
 			return (p);
 		}
 		p = sp->fts_child;
@@ -501,6 +648,7 @@ name:		t = sp->fts_path + NAPPEND(p->fts_parent);
 		SET(FTS_STOP);
 		return (NULL);
 	}
+	fsu_fts_leave(sp, p);
 	p->fts_info = p->fts_errno ? FTS_ERR : FTS_DP;
 	return (sp->fts_cur = p);
 }
@@ -528,6 +676,37 @@ fsu_fts_set(FSU_FTS *sp, FSU_FTSENT *p, int instr)
 	return (0);
 }
 
+/*
+ * Sorts the entries below the root level on a key instead of calling the
+ * comparison function, which still orders the root entries.  The order
+ * is the one of the usual comparisons on the key, the name breaking the
+ * ties, and entries that could not be stat'ed come last, by name.
+ */
+int
+fsu_fts_setsort(FSU_FTS *sp, int key)
+{
+
+	_DIAGASSERT(sp != NULL);
+
+	switch (key & ~FTS_SORT_REVERSE) {
+	case 0:
+		if (key == 0)
+			break;
+		/* FALLTHROUGH */
+	default:
+		errno = EINVAL;
+		return (1);
+	case FTS_SORT_NAME:
+	case FTS_SORT_SIZE:
+	case FTS_SORT_MTIME:
+	case FTS_SORT_ATIME:
+	case FTS_SORT_CTIME:
+		break;
+	}
+	sp->fts_sortkey = key;
+	return (0);
+}
+
 FSU_FTSENT *
 fsu_fts_children(FSU_FTS *sp, int instr)
 {
@@ -600,17 +779,16 @@ fsu_fts_children(FSU_FTS *sp, int instr)
  *
  * The real slowdown in walking the tree is the stat calls.  If FTS_NOSTAT is
  * set and it's a physical walk (so that symbolic links can't be directories),
- * we can do things quickly.  First, if it's a 4.4BSD file system, the type
- * of the file is in the directory entry.  Otherwise, we assume that the number
- * of subdirectories in a node is equal to the number of links to the parent.
- * The former skips all stat calls.  The latter skips stat calls in any leaf
- * directories and for any files after the subdirectories in the directory have
- * been found, cutting the stat calls by about 2/3.
+ * we can do things quickly: the type of the file is taken from the directory
+ * entry.  Files are returned as FTS_NSOK and directories as FTS_D without a
+ * stat call, unless FTS_XDEV needs their device.  Only entries of unknown
+ * type are stat'ed.  The number of links to the parent isn't used to guess
+ * the number of subdirectories, many file systems don't maintain it.
  */
 static FSU_FTSENT *
 fsu_fts_build(FSU_FTS *sp, int type)
 {
-	struct dirent *dp;
+	struct fsu_dirent ents[FSU_FTS_NBATCH], *dp;
 	FSU_FTSENT *p, *head;
 	size_t nitems;
 	FSU_FTSENT *cur, *tail;
@@ -618,6 +796,8 @@ fsu_fts_build(FSU_FTS *sp, int type)
 	void *oldaddr;
 	size_t dnamlen;
 	int cderrno, descend, level, nlinks, saved_errno, nostat, doadjust;
+	int i, nent;
+	size_t nstat;
 	size_t len, maxlen;
 /*#ifdef FSU_FTS_WHITEOUT
 	int oflag;
@@ -629,6 +809,13 @@ fsu_fts_build(FSU_FTS *sp, int type)
 	/* Set current node pointer. */
 	cur = sp->fts_cur;
 
+	/* Its entries are checked against it and its parents for cycles. */
+	if (fsu_fts_ancadd(sp, cur)) {
+		cur->fts_info = FTS_ERR;
+		SET(FTS_STOP);
+		return (NULL);
+	}
+
 	/*
 	 * Open the directory for reading.  If this fails, we're done.
 	 * If being called from fsu_fts_read, set the fts_info field.
@@ -643,7 +830,15 @@ fsu_fts_build(FSU_FTS *sp, int type)
   #define	__opendir2(path, flag) opendir(path)
   #endif
 */
-	if ((dirp = fsu_opendir(cur->fts_accpath)) == NULL) {
+	if (ISSET(FTS_DIRFD)) {
+		/* fsu_fts_children may have read it already. */
+		if ((dirp = fsu_fts_dir(sp, cur)) != NULL && dirp->dd_off > 0)
+			fsu_rewinddir(dirp);
+	} else
+		dirp = fsu_opendir_hint(cur->fts_accpath,
+		    cur->fts_statp != NULL && cur->fts_info == FTS_D ?
+		    (size_t)cur->fts_statp->st_size : 0);
+	if (dirp == NULL) {
 		if (type == BREAD) {
 			cur->fts_info = FTS_DNR;
 			cur->fts_errno = errno;
@@ -660,7 +855,7 @@ fsu_fts_build(FSU_FTS *sp, int type)
 		nlinks = 0;
 		nostat = 1;
 	} else if (ISSET(FTS_NOSTAT) && ISSET(FTS_PHYSICAL)) {
-		nlinks = cur->fts_nlink - (ISSET(FTS_SEEDOT) ? 0 : 2);
+		nlinks = -1;
 		nostat = 1;
 	} else {
 		nlinks = -1;
@@ -719,7 +914,7 @@ fsu_fts_build(FSU_FTS *sp, int type)
 	maxlen = sp->fts_pathlen - len;
 
 	if (cur->fts_level == SHRT_MAX) {
-		(void)fsu_closedir(dirp);
+		BCLOSEDIR(dirp);
 		cur->fts_info = FTS_ERR;
 		SET(FTS_STOP);
 		errno = ENAMETOOLONG;
@@ -730,16 +925,19 @@ fsu_fts_build(FSU_FTS *sp, int type)
 
 	/* Read the directory, attaching each entry to the `link' pointer. */
 	doadjust = 0;
-	for (head = tail = NULL, nitems = 0;
-	     (dp = fsu_readdir(dirp)) != NULL;) {
-		if (!ISSET(FTS_SEEDOT) && ISDOT(dp->d_name))
+	nstat = 0;
+	for (head = tail = NULL, nitems = 0, i = nent = 0;; ++i) {
+		if (i == nent) {
+			nent = fsu_readdir_batch(dirp, ents, FSU_FTS_NBATCH);
+			if (nent <= 0)
+				break;
+			i = 0;
+		}
+		dp = &ents[i];
+		if (!ISSET(FTS_SEEDOT) && ISDOT(dp->de_name))
 			continue;
-#if defined(HAVE_STRUCT_DIRENT_D_NAMLEN)
-		dnamlen = dp->d_namlen;
-#else
-		dnamlen = strlen(dp->d_name);
-#endif
-		if ((p = fsu_fts_alloc(sp, dp->d_name, dnamlen)) == NULL)
+		dnamlen = dp->de_namlen;
+		if ((p = fsu_fts_alloc(sp, dp->de_name, dnamlen)) == NULL)
 			goto mem1;
 		if (dnamlen >= maxlen) {	/* include space for NUL */
 			oldaddr = sp->fts_path;
@@ -753,7 +951,7 @@ mem1:				saved_errno = errno;
 				if (p)
 					fsu_fts_free(p);
 				fsu_fts_lfree(head);
-				fsu_closedir(dirp);
+				BCLOSEDIR(dirp);
 				errno = saved_errno;
 				cur->fts_info = FTS_ERR;
 				SET(FTS_STOP);
@@ -779,7 +977,7 @@ mem1:				saved_errno = errno;
 			 */
 			fsu_fts_free(p);
 			fsu_fts_lfree(head);
-			fsu_closedir(dirp);
+			BCLOSEDIR(dirp);
 			cur->fts_info = FTS_ERR;
 			SET(FTS_STOP);
 			errno = ENAMETOOLONG;
@@ -791,7 +989,7 @@ mem1:				saved_errno = errno;
 		p->fts_parent = sp->fts_cur;
 
 #ifdef FTS_WHITEOUT
-		if (dp->d_type == DT_WHT)
+		if (dp->de_type == DT_WHT)
 			p->fts_flags |= FTS_ISW;
 #endif
 
@@ -805,12 +1003,23 @@ mem1:				saved_errno = errno;
 		} else if (nlinks == 0
 #ifdef DT_DIR
 			   || (nostat &&
-			       dp->d_type != DT_DIR && dp->d_type != DT_UNKNOWN)
+			       dp->de_type != DT_DIR && dp->de_type != DT_UNKNOWN)
 #endif
 			   ) {
 			p->fts_accpath =
 			    ISSET(FTS_NOCHDIR) ? p->fts_path : p->fts_name;
 			p->fts_info = FTS_NSOK;
+#ifdef DT_DIR
+		} else if (nostat && dp->de_type == DT_DIR &&
+			   !ISSET(FTS_XDEV) && !ISDOT(dp->de_name)) {
+			/* No cycle without symbolic links, nothing to check. */
+			p->fts_accpath =
+			    ISSET(FTS_NOCHDIR) ? p->fts_path : p->fts_name;
+			p->fts_dev = cur->fts_dev;
+			p->fts_ino = dp->de_ino;
+			p->fts_nlink = 0;
+			p->fts_info = FTS_D;
+#endif
 		} else {
 			/* Build a file name for fsu_fts_stat to stat. */
 			if (ISSET(FTS_NOCHDIR)) {
@@ -819,6 +1028,13 @@ mem1:				saved_errno = errno;
 				    (size_t)(p->fts_namelen + 1));
 			} else
 				p->fts_accpath = p->fts_name;
+			if (ISSET(FTS_INOSORT)) {
+				/* Stat'ed once the directory is read. */
+				p->fts_ino = dp->de_ino;
+				p->fts_info = FTS_INIT;
+				++nstat;
+				goto link;
+			}
 			/* Stat it. */
 			p->fts_info = fsu_fts_stat(sp, p, 0);
 			/* Decrement link count if applicable. */
@@ -829,7 +1045,7 @@ mem1:				saved_errno = errno;
 		}
 
 		/* We walk in directory order so "ls -f" doesn't get upset. */
-		p->fts_link = NULL;
+link:		p->fts_link = NULL;
 		if (head == NULL)
 			head = tail = p;
 		else {
@@ -838,7 +1054,7 @@ mem1:				saved_errno = errno;
 		}
 		++nitems;
 	}
-	fsu_closedir(dirp);
+	BCLOSEDIR(dirp);
 
 	/*
 	 * If had to realloc the path, adjust the addresses for the rest
@@ -847,6 +1063,9 @@ mem1:				saved_errno = errno;
 	if (doadjust)
 		fsu_fts_padjust(sp, head);
 
+	if (nstat > 0)
+		fsu_fts_inostat(sp, head, nstat, cp);
+
 	/*
 	 * If not changing directories, reset the path back to original
 	 * state.
@@ -886,6 +1105,235 @@ mem1:				saved_errno = errno;
 	return (head);
 }
 
+/*
+ * Returns the directory of node p open, from the FTS_DIRFD cache or
+ * opened relative to its parent's.
+ */
+static FSU_DIR *
+fsu_fts_dir(FSU_FTS *sp, const FSU_FTSENT *p)
+{
+	struct fsu_fts_dirs *fd;
+	struct fsu_fts_dirslot *dc, *lru;
+	FSU_DIR *dirp;
+	size_t hint;
+	int dfd, i, saved_errno;
+	char c;
+
+	fd = sp->fts_dirs;
+	for (i = 0; i < FSU_FTS_NDIRS; i++) {
+		dc = &fd->fd_slots[i];
+		if (dc->dc_dir != NULL && dc->dc_ent == p &&
+		    dc->dc_ino == p->fts_ino) {
+			dc->dc_used = ++fd->fd_clock;
+			return (dc->dc_dir);
+		}
+	}
+
+	/*
+	 * The path of a root is at the start of the current one, in which
+	 * it can be terminated for a moment.
+	 */
+	if (p->fts_level <= FTS_ROOTLEVEL) {
+		c = sp->fts_path[p->fts_pathlen];
+		sp->fts_path[p->fts_pathlen] = '\0';
+		dfd = rump_sys_open(sp->fts_path,
+		    RUMP_O_RDONLY | RUMP_O_DIRECTORY);
+		sp->fts_path[p->fts_pathlen] = c;
+	} else {
+		if ((dirp = fsu_fts_dir(sp, p->fts_parent)) == NULL)
+			return (NULL);
+		dfd = rump_sys_openat(dirp->dd_fd, p->fts_name,
+		    RUMP_O_RDONLY | RUMP_O_DIRECTORY);
+	}
+	if (dfd == -1)
+		return (NULL);
+
+	hint = p->fts_statp != NULL && p->fts_info == FTS_D ?
+	    (size_t)p->fts_statp->st_size : 0;
+	if ((dirp = fsu_fdopendir(dfd, hint)) == NULL) {
+		saved_errno = errno;
+		rump_sys_close(dfd);
+		errno = saved_errno;
+		return (NULL);
+	}
+
+	/* Take the slot used the longest ago, parents come back often. */
+	lru = &fd->fd_slots[0];
+	for (i = 1; i < FSU_FTS_NDIRS; i++)
+		if (fd->fd_slots[i].dc_used < lru->dc_used)
+			lru = &fd->fd_slots[i];
+	if (lru->dc_dir != NULL)
+		fsu_closedir(lru->dc_dir);
+	lru->dc_dir = dirp;
+	lru->dc_ent = p;
+	lru->dc_ino = p->fts_ino;
+	lru->dc_used = ++fd->fd_clock;
+	return (dirp);
+}
+
+/* Closes the directory of node p if it is in the FTS_DIRFD cache. */
+static void
+fsu_fts_dirdrop(FSU_FTS *sp, const FSU_FTSENT *p)
+{
+	struct fsu_fts_dirslot *dc;
+	int i;
+
+	if (sp->fts_dirs == NULL)
+		return;
+	for (i = 0; i < FSU_FTS_NDIRS; i++) {
+		dc = &sp->fts_dirs->fd_slots[i];
+		if (dc->dc_dir != NULL && dc->dc_ent == p) {
+			fsu_closedir(dc->dc_dir);
+			memset(dc, 0, sizeof(*dc));
+			return;
+		}
+	}
+}
+
+/* After the post-order visit of p, or when it is skipped. */
+static void
+fsu_fts_leave(FSU_FTS *sp, FSU_FTSENT *p)
+{
+
+	fsu_fts_ancdel(sp, p);
+	fsu_fts_dirdrop(sp, p);
+}
+
+static size_t
+fsu_fts_anchash(dev_t dev, __fsu_fts_ino_t ino)
+{
+	uint64_t h;
+
+	h = ((uint64_t)ino ^ ((uint64_t)dev << 32 | (uint64_t)dev >> 32)) *
+	    UINT64_C(0x9e3779b97f4a7c15);
+	return ((size_t)(h >> 32));
+}
+
+/* Adds the directory p to those being walked, unless one has its key. */
+static int
+fsu_fts_ancadd(FSU_FTS *sp, FSU_FTSENT *p)
+{
+	struct fsu_fts_anc *an;
+	FSU_FTSENT **tab, *t;
+	size_t i, j, mask, size;
+
+	if (!ISSET(FTS_LOGICAL) ||
+	    fsu_fts_ancfind(sp, p->fts_dev, p->fts_ino) != NULL)
+		return (0);
+
+	if ((an = sp->fts_anc) == NULL) {
+		if ((an = calloc(1, sizeof(*an))) == NULL)
+			return (-1);
+		sp->fts_anc = an;
+	}
+
+	/* Keep it at most half full. */
+	if (2 * (an->an_count + 1) > an->an_size) {
+		size = an->an_size ? 2 * an->an_size : FSU_FTS_NANC;
+		if ((tab = calloc(size, sizeof(*tab))) == NULL)
+			return (-1);
+		mask = size - 1;
+		for (i = 0; i < an->an_size; i++) {
+			if ((t = an->an_tab[i]) == NULL)
+				continue;
+			for (j = fsu_fts_anchash(t->fts_dev, t->fts_ino) & mask;
+			     tab[j] != NULL; j = (j + 1) & mask)
+				continue;
+			tab[j] = t;
+		}
+		free(an->an_tab);
+		an->an_tab = tab;
+		an->an_size = size;
+	}
+
+	mask = an->an_size - 1;
+	for (i = fsu_fts_anchash(p->fts_dev, p->fts_ino) & mask;
+	     an->an_tab[i] != NULL; i = (i + 1) & mask)
+		continue;
+	an->an_tab[i] = p;
+	an->an_count++;
+	return (0);
+}
+
+/*
+ * Removes the directory p from those being walked, if it was added by
+ * fsu_fts_ancadd and not found there under its key.
+ */
+static void
+fsu_fts_ancdel(FSU_FTS *sp, const FSU_FTSENT *p)
+{
+	struct fsu_fts_anc *an;
+	FSU_FTSENT *t;
+	size_t i, j, k, mask;
+
+	if (!ISSET(FTS_LOGICAL) ||
+	    (an = sp->fts_anc) == NULL || an->an_count == 0)
+		return;
+
+	mask = an->an_size - 1;
+	for (i = fsu_fts_anchash(p->fts_dev, p->fts_ino) & mask;
+	     (t = an->an_tab[i]) != NULL; i = (i + 1) & mask)
+		if (t->fts_ino == p->fts_ino && t->fts_dev == p->fts_dev)
+			break;
+	if (t != p)
+		return;
+	an->an_tab[i] = NULL;
+	an->an_count--;
+
+	/*
+	 * Move back the entries that follow in the cluster and can take
+	 * the slot freed, so that lookups don't need tombstones.
+	 */
+	for (j = (i + 1) & mask; (t = an->an_tab[j]) != NULL;
+	     j = (j + 1) & mask) {
+		k = fsu_fts_anchash(t->fts_dev, t->fts_ino) & mask;
+		if (((j - k) & mask) >= ((j - i) & mask)) {
+			an->an_tab[i] = t;
+			an->an_tab[j] = NULL;
+			i = j;
+		}
+	}
+}
+
+/* Returns the directory being walked with this device and inode. */
+static FSU_FTSENT *
+fsu_fts_ancfind(FSU_FTS *sp, dev_t dev, __fsu_fts_ino_t ino)
+{
+	struct fsu_fts_anc *an;
+	FSU_FTSENT *t;
+	size_t i, mask;
+
+	if ((an = sp->fts_anc) == NULL || an->an_count == 0)
+		return (NULL);
+
+	mask = an->an_size - 1;
+	for (i = fsu_fts_anchash(dev, ino) & mask;
+	     (t = an->an_tab[i]) != NULL; i = (i + 1) & mask)
+		if (t->fts_ino == ino && t->fts_dev == dev)
+			return (t);
+	return (NULL);
+}
+
+/*
+ * Stats p, following it if it is a symbolic link and follow is set.
+ * With FTS_DIRFD, it is looked up relative to its parent directory.
+ */
+static int
+fsu_fts_xstat(FSU_FTS *sp, FSU_FTSENT *p, __fsu_fts_stat_t *sbp, int follow)
+{
+	FSU_DIR *dirp;
+
+	if (ISSET(FTS_DIRFD) && p->fts_level > FTS_ROOTLEVEL) {
+		if ((dirp = fsu_fts_dir(sp, p->fts_parent)) == NULL)
+			return (-1);
+		return (rump_sys_fstatat(dirp->dd_fd, p->fts_name, sbp,
+		    follow ? 0 : RUMP_AT_SYMLINK_NOFOLLOW));
+	}
+	if (follow)
+		return (rump_sys_stat(p->fts_accpath, sbp));
+	return (rump_sys_lstat(p->fts_accpath, sbp));
+}
+
 static unsigned short
 fsu_fts_stat(FSU_FTS *sp, FSU_FTSENT *p, int follow)
 {
@@ -918,16 +1366,16 @@ fsu_fts_stat(FSU_FTS *sp, FSU_FTSENT *p, int follow)
 	 * fail, set the errno from the stat call.
 	 */
 	if (ISSET(FTS_LOGICAL) || follow) {
-		if (rump_sys_stat(p->fts_accpath, sbp)) {
+		if (fsu_fts_xstat(sp, p, sbp, 1)) {
 			saved_errno = errno;
-			if (!rump_sys_lstat(p->fts_accpath, sbp)) {
+			if (!fsu_fts_xstat(sp, p, sbp, 0)) {
 				errno = 0;
 				return (FTS_SLNONE);
 			}
 			p->fts_errno = saved_errno;
 			goto err;
 		}
-	} else if (rump_sys_lstat(p->fts_accpath, sbp)) {
+	} else if (fsu_fts_xstat(sp, p, sbp, 0)) {
 		p->fts_errno = errno;
 err:		memset(sbp, 0, sizeof(*sbp));
 		return (FTS_NS);
@@ -949,11 +1397,18 @@ err:		memset(sbp, 0, sizeof(*sbp));
 			return (FTS_DOT);
 
 		/*
-		 * Cycle detection is done by brute force when the directory
-		 * is first encountered.  If the tree gets deep enough or the
-		 * number of symbolic links to directories is high enough,
-		 * something faster might be worthwhile.
+		 * Cycle detection is done when the directory is first
+		 * encountered, it is one of the directories being walked.
+		 * That is p itself if it is stat'ed again.
 		 */
+		if (ISSET(FTS_LOGICAL)) {
+			if ((t = fsu_fts_ancfind(sp, dev, ino)) != NULL &&
+			    t != p) {
+				p->fts_cycle = t;
+				return (FTS_DC);
+			}
+			return (FTS_D);
+		}
 		for (t = p->fts_parent;
 		     t->fts_level >= FTS_ROOTLEVEL; t = t->fts_parent)
 			if (ino == t->fts_ino && dev == t->fts_dev) {
@@ -969,6 +1424,260 @@ err:		memset(sbp, 0, sizeof(*sbp));
 	return (FTS_DEFAULT);
 }
 
+static int
+fsu_fts_inocmp(const void *a, const void *b)
+{
+	const FSU_FTSENT *pa, *pb;
+
+	pa = *(const FSU_FTSENT * const *)a;
+	pb = *(const FSU_FTSENT * const *)b;
+	if (pa->fts_ino != pb->fts_ino)
+		return (pa->fts_ino < pb->fts_ino ? -1 : 1);
+	return (0);
+}
+
+/*
+ * Stats the nstat entries of the list left for it by fsu_fts_build, in
+ * the order of their inode numbers, as the inodes are laid out in the
+ * image, rather than in the order of the directory.  The list keeps its
+ * order.  With FTS_NOCHDIR, names are appended to the path at cp.  If
+ * memory is short, they are stat'ed in the order of the list.
+ */
+static void
+fsu_fts_inostat(FSU_FTS *sp, FSU_FTSENT *head, size_t nstat, char *cp)
+{
+	FSU_FTSENT **ap, *p;
+	size_t i;
+
+	if (nstat > sp->fts_nitems) {
+		FSU_FTSENT **new;
+
+		new = realloc(sp->fts_array,
+			      sizeof(FSU_FTSENT *) * (nstat + 40));
+		if (new != NULL) {
+			sp->fts_array = new;
+			sp->fts_nitems = nstat + 40;
+		}
+	}
+	if (nstat <= sp->fts_nitems) {
+		for (ap = sp->fts_array, p = head; p; p = p->fts_link)
+			if (p->fts_info == FTS_INIT)
+				*ap++ = p;
+		qsort(sp->fts_array, nstat, sizeof(FSU_FTSENT *),
+		    fsu_fts_inocmp);
+		for (i = 0; i < nstat; i++) {
+			p = sp->fts_array[i];
+			if (ISSET(FTS_NOCHDIR))
+				memmove(cp, p->fts_name,
+				    (size_t)(p->fts_namelen + 1));
+			p->fts_info = fsu_fts_stat(sp, p, 0);
+		}
+		return;
+	}
+
+	for (p = head; p; p = p->fts_link) {
+		if (p->fts_info != FTS_INIT)
+			continue;
+		if (ISSET(FTS_NOCHDIR))
+			memmove(cp, p->fts_name, (size_t)(p->fts_namelen + 1));
+		p->fts_info = fsu_fts_stat(sp, p, 0);
+	}
+}
+
+/*
+ * Loads the digit at depth d of n keys.  A name digit past the first one
+ * is only loaded when the previous ones did not end the name.
+ */
+static void
+fsu_fts_skload(struct fsu_fts_skey *k, size_t n, int d, int nnum,
+	       uint64_t mask)
+{
+	const unsigned char *cp;
+	uint64_t w;
+	size_t i, len;
+
+	if (d < nnum) {
+		for (; n > 0; n--, k++)
+			k->sk_digit = k->sk_num[d];
+		return;
+	}
+	d -= nnum;
+	for (; n > 0; n--, k++) {
+		cp = (const unsigned char *)k->sk_ent->fts_name +
+		    d * FSU_FTS_SKW;
+		len = k->sk_ent->fts_namelen - d * FSU_FTS_SKW;
+		if (len > FSU_FTS_SKW)
+			len = FSU_FTS_SKW;
+		for (w = 0, i = 0; i < FSU_FTS_SKW; i++)
+			w = w << 8 | (i < len ? cp[i] : 0);
+		k->sk_digit = w ^ mask;
+	}
+}
+
+/* The last digit of a name has a NUL in its last byte. */
+#define	SKLAST(digit, d, nnum, mask) \
+	((d) >= (nnum) && (((digit) ^ (mask)) & 0xff) == 0)
+
+/* Compares two keys whose digits at depth d are loaded. */
+static int
+fsu_fts_skcmp(const struct fsu_fts_skey *a, const struct fsu_fts_skey *b,
+	      int d, int nnum, uint64_t mask)
+{
+	struct fsu_fts_skey ka, kb;
+
+	ka = *a;
+	kb = *b;
+	for (;;) {
+		if (ka.sk_digit != kb.sk_digit)
+			return (ka.sk_digit < kb.sk_digit ? -1 : 1);
+		if (SKLAST(ka.sk_digit, d, nnum, mask))
+			return (0);
+		d++;
+		fsu_fts_skload(&ka, 1, d, nnum, mask);
+		fsu_fts_skload(&kb, 1, d, nnum, mask);
+	}
+}
+
+/* Sorts n keys whose digits at depth d are loaded. */
+static void
+fsu_fts_skqsort(struct fsu_fts_skey *k, size_t n, int d, int nnum,
+		uint64_t mask)
+{
+	struct fsu_fts_skey t;
+	uint64_t a, b, c, v;
+	size_t i, j, lt, gt;
+
+#define	SKSWAP(x, y)	do { t = (x); (x) = (y); (y) = t; } while (0)
+
+	for (;;) {
+		if (n < FSU_FTS_SKSMALL) {
+			for (i = 1; i < n; i++)
+				for (j = i; j > 0 && fsu_fts_skcmp(&k[j - 1],
+				    &k[j], d, nnum, mask) > 0; j--)
+					SKSWAP(k[j - 1], k[j]);
+			return;
+		}
+
+		/* Median of three, then a three-way partition. */
+		a = k[0].sk_digit;
+		b = k[n / 2].sk_digit;
+		c = k[n - 1].sk_digit;
+		if (a > b) {
+			v = a;
+			a = b;
+			b = v;
+		}
+		v = c < a ? a : c > b ? b : c;
+		for (lt = i = 0, gt = n; i < gt;) {
+			if (k[i].sk_digit < v) {
+				SKSWAP(k[lt], k[i]);
+				lt++;
+				i++;
+			} else if (k[i].sk_digit > v) {
+				gt--;
+				SKSWAP(k[i], k[gt]);
+			} else
+				i++;
+		}
+
+		/* The keys equal on this digit go on with the next one. */
+		if (gt - lt > 1 && !SKLAST(v, d, nnum, mask)) {
+			fsu_fts_skload(k + lt, gt - lt, d + 1, nnum, mask);
+			fsu_fts_skqsort(k + lt, gt - lt, d + 1, nnum, mask);
+		}
+
+		/* Recurse on the smaller side, loop on the larger one. */
+		if (lt < n - gt) {
+			fsu_fts_skqsort(k, lt, d, nnum, mask);
+			k += gt;
+			n -= gt;
+		} else {
+			fsu_fts_skqsort(k + gt, n - gt, d, nnum, mask);
+			n = lt;
+		}
+	}
+#undef	SKSWAP
+}
+
+/*
+ * Sorts with the fsu_fts_setsort key.  Returns NULL if the entries have
+ * to be left to the comparison function: some have an error, or were not
+ * stat'ed while the key needs it, or there is no memory for the keys.
+ */
+static FSU_FTSENT *
+fsu_fts_keysort(FSU_FTS *sp, FSU_FTSENT *head, size_t nitems)
+{
+	struct fsu_fts_skey *k, *ns;
+	__fsu_fts_stat_t *sbp;
+	FSU_FTSENT *p;
+	uint64_t mask;
+	size_t n;
+	int key, nnum;
+
+	key = sp->fts_sortkey & ~FTS_SORT_REVERSE;
+	mask = sp->fts_sortkey & FTS_SORT_REVERSE ? ~(uint64_t)0 : 0;
+	nnum = key == FTS_SORT_NAME ? 0 : key == FTS_SORT_SIZE ? 1 : 2;
+
+	if (nitems > sp->fts_nskeys) {
+		struct fsu_fts_skey *new;
+
+		new = realloc(sp->fts_skeys,
+			      sizeof(struct fsu_fts_skey) * (nitems + 40));
+		if (new == NULL)
+			return (NULL);
+		sp->fts_skeys = new;
+		sp->fts_nskeys = nitems + 40;
+	}
+
+	/* Stat'ed entries fill the array up, the others down from its end. */
+	k = sp->fts_skeys;
+	ns = k + nitems;
+	for (p = head; p; p = p->fts_link) {
+		if (p->fts_info == FTS_ERR ||
+		    (nnum > 0 && p->fts_info == FTS_NSOK))
+			return (NULL);
+		if (p->fts_info == FTS_NS) {
+			(--ns)->sk_ent = p;
+			continue;
+		}
+		sbp = p->fts_statp;
+		k->sk_num[0] = k->sk_num[1] = 0;
+		switch (key) {
+		case FTS_SORT_SIZE:
+			k->sk_num[0] = FSU_FTS_SKNUM(sbp->st_size);
+			break;
+		case FTS_SORT_MTIME:
+			k->sk_num[0] = FSU_FTS_SKNUM(sbp->st_mtime);
+			k->sk_num[1] = FSU_FTS_SKNUM(FSU_FTS_NSEC(sbp, m));
+			break;
+		case FTS_SORT_ATIME:
+			k->sk_num[0] = FSU_FTS_SKNUM(sbp->st_atime);
+			k->sk_num[1] = FSU_FTS_SKNUM(FSU_FTS_NSEC(sbp, a));
+			break;
+		case FTS_SORT_CTIME:
+			k->sk_num[0] = FSU_FTS_SKNUM(sbp->st_ctime);
+			k->sk_num[1] = FSU_FTS_SKNUM(FSU_FTS_NSEC(sbp, c));
+			break;
+		}
+		/* Sizes and times are largest first. */
+		k->sk_num[0] = ~k->sk_num[0] ^ mask;
+		k->sk_num[1] = ~k->sk_num[1] ^ mask;
+		k->sk_ent = p;
+		k++;
+	}
+	n = k - sp->fts_skeys;
+
+	fsu_fts_skload(sp->fts_skeys, n, 0, nnum, mask);
+	fsu_fts_skqsort(sp->fts_skeys, n, 0, nnum, mask);
+	fsu_fts_skload(ns, nitems - n, 0, 0, 0);
+	fsu_fts_skqsort(ns, nitems - n, 0, 0, 0);
+
+	for (head = (k = sp->fts_skeys)->sk_ent; --nitems; ++k)
+		k[0].sk_ent->fts_link = k[1].sk_ent;
+	k[0].sk_ent->fts_link = NULL;
+	return (head);
+}
+
 static FSU_FTSENT *
 fsu_fts_sort(FSU_FTS *sp, FSU_FTSENT *head, size_t nitems)
 {
@@ -977,6 +1686,10 @@ fsu_fts_sort(FSU_FTS *sp, FSU_FTSENT *head, size_t nitems)
 	_DIAGASSERT(sp != NULL);
 	_DIAGASSERT(head != NULL);
 
+	if (sp->fts_sortkey && head->fts_level > FTS_ROOTLEVEL &&
+	    (p = fsu_fts_keysort(sp, head, nitems)) != NULL)
+		return (p);
+
 	/*
 	 * Construct an array of pointers to the structures and call qsort(3).
 	 * Reassemble the array in the order returned by qsort.  If unable to
@@ -1008,44 +1721,26 @@ static FSU_FTSENT *
 fsu_fts_alloc(FSU_FTS *sp, const char *name, size_t namelen)
 {
 	FSU_FTSENT *p;
-#if defined(FTS_ALLOC_ALIGNED)
 	size_t len;
-#endif
 
 	_DIAGASSERT(sp != NULL);
 	_DIAGASSERT(name != NULL);
 
-#if defined(FTS_ALLOC_ALIGNED)
 	/*
 	 * The file name is a variable length array and no stat structure is
 	 * necessary if the user has set the nostat bit.  Allocate the FSU_FTSENT
-	 * structure, the file name and the stat structure in one chunk, but
-	 * be careful that the stat structure is reasonably aligned.  Since the
-	 * fts_name field is declared to be of size 1, the fts_name pointer is
-	 * namelen + 2 before the first possible address of the stat structure.
+	 * structure, the file name and the stat structure in one piece, the
+	 * stat structure aligned after the name.
 	 */
-	len = sizeof(FSU_FTSENT) + namelen;
-	if (!ISSET(FTS_NOSTAT))
-		len += sizeof(*(p->fts_statp)) + ALIGNBYTES;
-	if ((p = malloc(len)) == NULL)
-		return (NULL);
-
-	if (!ISSET(FTS_NOSTAT))
-		p->fts_statp = (__fsu_fts_stat_t *)ALIGN(
-		    (unsigned long)(p->fts_name + namelen + 2));
-#else
-	if ((p = malloc(sizeof(FSU_FTSENT) + namelen)) == NULL)
+	len = FSU_FTS_ALIGN(sizeof(FSU_FTSENT) + namelen);
+	if ((p = fsu_fts_amalloc(sp->fts_arena, len +
+	    (ISSET(FTS_NOSTAT) ? 0 : sizeof(*(p->fts_statp))))) == NULL)
 		return (NULL);
 
-	if (!ISSET(FTS_NOSTAT))
-		if ((p->fts_statp = malloc(sizeof(*(p->fts_statp)))) == NULL) {
-			free(p);
-			return (NULL);
-		}
-#endif
-
-        if (ISSET(FTS_NOSTAT))
-                p->fts_statp = NULL;
+	if (ISSET(FTS_NOSTAT))
+		p->fts_statp = NULL;
+	else
+		p->fts_statp = (__fsu_fts_stat_t *)((char *)p + len);
 
 	/* Copy the name plus the trailing NULL. */
 	memmove(p->fts_name, name, namelen + 1);
@@ -1063,11 +1758,21 @@ fsu_fts_alloc(FSU_FTS *sp, const char *name, size_t namelen)
 static void
 fsu_fts_free(FSU_FTSENT *p)
 {
-#if !defined(FTS_ALLOC_ALIGNED)
-	if (p->fts_statp)
-		free(p->fts_statp);
-#endif
-	free(p);
+	struct fsu_fts_chunk *ch;
+	struct fsu_fts_arena *fa;
+
+	ch = *(struct fsu_fts_chunk **)(void *)((char *)p - FSU_FTS_HDR);
+	if (--ch->ch_live > 0)
+		return;
+
+	/* The chunk is empty, carve it again or keep it for later. */
+	fa = ch->ch_arena;
+	if (ch == fa->fa_cur)
+		ch->ch_used = FSU_FTS_CHUNKHDR;
+	else {
+		ch->ch_free = fa->fa_free;
+		fa->fa_free = ch;
+	}
 }
 
 static void
@@ -1084,6 +1789,62 @@ fsu_fts_lfree(FSU_FTSENT *head)
 	}
 }
 
+/* Allocates len bytes for an entry */
+static void *
+fsu_fts_amalloc(struct fsu_fts_arena *fa, size_t len)
+{
+	struct fsu_fts_chunk *ch;
+	char *mem;
+
+	len = FSU_FTS_HDR + FSU_FTS_ALIGN(len);
+	if (FSU_FTS_CHUNKHDR + len > FSU_FTS_CHUNK) {
+		errno = ENAMETOOLONG;
+		return (NULL);
+	}
+
+	ch = fa->fa_cur;
+	if (ch == NULL || ch->ch_used + len > FSU_FTS_CHUNK) {
+		if (ch != NULL && ch->ch_live == 0)
+			ch->ch_used = FSU_FTS_CHUNKHDR;
+		else if ((ch = fa->fa_free) != NULL) {
+			fa->fa_free = ch->ch_free;
+			++fa->fa_stats.fst_reuses;
+		} else {
+			if ((ch = malloc(FSU_FTS_CHUNK)) == NULL)
+				return (NULL);
+			ch->ch_next = fa->fa_chunks;
+			fa->fa_chunks = ch;
+			ch->ch_arena = fa;
+			++fa->fa_stats.fst_chunks;
+			fa->fa_stats.fst_bytes += FSU_FTS_CHUNK;
+		}
+		ch->ch_used = FSU_FTS_CHUNKHDR;
+		ch->ch_live = 0;
+		fa->fa_cur = ch;
+	}
+
+	mem = (char *)ch + ch->ch_used;
+	ch->ch_used += len;
+	++ch->ch_live;
+	++fa->fa_stats.fst_entries;
+	*(struct fsu_fts_chunk **)(void *)mem = ch;
+	return (mem + FSU_FTS_HDR);
+}
+
+/* Frees all the chunks, whatever entries they still hold */
+static void
+fsu_fts_adestroy(struct fsu_fts_arena *fa)
+{
+	struct fsu_fts_chunk *ch;
+
+	fsu_stats_ftsclosed(&fa->fa_stats);
+	while ((ch = fa->fa_chunks) != NULL) {
+		fa->fa_chunks = ch->ch_next;
+		free(ch);
+	}
+	free(fa);
+}
+
 static size_t
 fsu_fts_pow2(size_t x)
 {
@@ -60,10 +60,12 @@
 #define	FTS_SEEDOT	0x020		/* return dot and dot-dot */
 #define	FTS_XDEV	0x040		/* don't cross devices */
 #define	FTS_WHITEOUT	0x080		/* return whiteout information */
-#define	FTS_OPTIONMASK	0x0ff		/* valid user option mask */
+#define	FTS_OPTIONMASK	0xcff		/* valid user option mask */
 
 #define	FTS_NAMEONLY	0x100		/* (private) child names only */
 #define	FTS_STOP	0x200		/* (private) unrecoverable error */
+#define	FTS_DIRFD	0x400		/* openat/fstatat, don't chdir */
+#define	FTS_INOSORT	0x800		/* stat entries in inode order */
 
 /* fts_level */
 #define	FTS_ROOTPARENTLEVEL	-1
@@ -98,6 +100,14 @@
 
 #endif /* !FTS_COMFOLLOW */
 
+/* fsu_fts_setsort keys */
+#define	FTS_SORT_NAME	1		/* by name */
+#define	FTS_SORT_SIZE	2		/* by size, largest first */
+#define	FTS_SORT_MTIME	3		/* by modification time, newest first */
+#define	FTS_SORT_ATIME	4		/* by access time, newest first */
+#define	FTS_SORT_CTIME	5		/* by status change time, newest first */
+#define	FTS_SORT_REVERSE 0x10		/* reverse the order */
+
 typedef struct {
 	struct _fsu_ftsent *fts_cur;	/* current node */
 	struct _fsu_ftsent *fts_child;	/* linked list of children */
@@ -110,7 +120,12 @@ typedef struct {
 	int (*fts_compar)		/* compare function */
 		(const struct _fsu_ftsent **, const struct _fsu_ftsent **);
 	int fts_options;		/* fsu_fts_open options, global flags */
-
+	struct fsu_fts_arena *fts_arena;	/* entries are allocated from */
+	struct fsu_fts_dirs *fts_dirs;	/* open directories, FTS_DIRFD */
+	struct fsu_fts_anc *fts_anc;	/* directories being walked */
+	struct fsu_fts_skey *fts_skeys;	/* key sort array */
+	unsigned int fts_nskeys;	/* elements in the key sort array */
+	int fts_sortkey;		/* fsu_fts_setsort key */
 } FSU_FTS;
 
 typedef struct _fsu_ftsent {
@@ -150,6 +165,7 @@ FSU_FTS		*fsu_fts_open(char * const *, int,
 				      const FSU_FTSENT **));
 FSU_FTSENT	*fsu_fts_read(FSU_FTS *);
 int		fsu_fts_set(FSU_FTS *, FSU_FTSENT *, int);
+int		fsu_fts_setsort(FSU_FTS *, int);
 
 
 #endif /* !_FSU_FTS_H_ */
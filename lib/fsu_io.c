@@ -0,0 +1,295 @@
+/*
+ * Copyright (c) 2026 The fs-utils authors.  All Rights Reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS
+ * OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include "fs-utils.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include <rump/rump.h>
+#include <rump/rump_syscalls.h>
+
+#include "fsu_io.h"
+#include "fsu_mount.h"
+#include "fsu_stats.h"
+
+/* default number of I/O threads, FSU_IOTHREADS overrides it */
+#define FSU_IO_NTHREADS (2)
+
+static void	fsu_io_fini(void);
+static int	fsu_io_init(void);
+static void	fsu_io_done(struct fsu_ioreq *);
+static void	fsu_io_run(struct fsu_ioreq *);
+static void	*fsu_io_worker(void *);
+
+static pthread_mutex_t fsu_io_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t fsu_io_cv = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t fsu_io_donecv = PTHREAD_COND_INITIALIZER;
+
+static struct fsu_ioreq *fsu_io_head, **fsu_io_tail = &fsu_io_head;
+static pthread_t *fsu_io_threads;
+static int fsu_io_nthreads;	/* -1 if the pool could not be started */
+static bool fsu_io_exiting;
+
+/*
+ * Queues a request.  If no I/O thread can be started, the request is
+ * run synchronously and is already completed on return.
+ */
+void
+fsu_io_submit(struct fsu_ioreq *req)
+{
+
+	req->ior_next = NULL;
+	req->ior_done = false;
+
+	pthread_mutex_lock(&fsu_io_lock);
+	if (fsu_io_nthreads == 0 && fsu_io_init() != 0)
+		fsu_io_nthreads = -1;
+	if (req->ior_cq != NULL)
+		++req->ior_cq->cq_pending;
+
+	if (fsu_io_nthreads == -1) {
+		pthread_mutex_unlock(&fsu_io_lock);
+		fsu_io_run(req);
+		pthread_mutex_lock(&fsu_io_lock);
+		fsu_io_done(req);
+		pthread_mutex_unlock(&fsu_io_lock);
+		return;
+	}
+
+	*fsu_io_tail = req;
+	fsu_io_tail = &req->ior_next;
+	pthread_cond_signal(&fsu_io_cv);
+	pthread_mutex_unlock(&fsu_io_lock);
+}
+
+/*
+ * Waits for the completion of a request.
+ * Returns true if the caller had to block.
+ */
+bool
+fsu_io_wait(struct fsu_ioreq *req)
+{
+	bool blocked;
+
+	blocked = false;
+	pthread_mutex_lock(&fsu_io_lock);
+	while (!req->ior_done) {
+		blocked = true;
+		pthread_cond_wait(&fsu_io_donecv, &fsu_io_lock);
+	}
+	pthread_mutex_unlock(&fsu_io_lock);
+	return blocked;
+}
+
+void
+fsu_iocq_init(struct fsu_iocq *cq)
+{
+
+	cq->cq_head = NULL;
+	cq->cq_tail = &cq->cq_head;
+	cq->cq_pending = 0;
+	pthread_cond_init(&cq->cq_cv, NULL);
+}
+
+void
+fsu_iocq_destroy(struct fsu_iocq *cq)
+{
+
+	pthread_cond_destroy(&cq->cq_cv);
+}
+
+/*
+ * Takes the oldest completed request off a completion queue.  If there
+ * is none, NULL is returned unless wait is set and requests are still
+ * pending, then the caller blocks until one completes.
+ */
+struct fsu_ioreq *
+fsu_iocq_get(struct fsu_iocq *cq, bool wait)
+{
+	struct fsu_ioreq *req;
+
+	pthread_mutex_lock(&fsu_io_lock);
+	while (cq->cq_head == NULL && wait && cq->cq_pending > 0)
+		pthread_cond_wait(&cq->cq_cv, &fsu_io_lock);
+	if ((req = cq->cq_head) != NULL &&
+	    (cq->cq_head = req->ior_next) == NULL)
+		cq->cq_tail = &cq->cq_head;
+	pthread_mutex_unlock(&fsu_io_lock);
+	return req;
+}
+
+/*
+ * Starts the I/O threads, called with fsu_io_lock held.
+ * Each thread gets a new lwp in the rump process of the caller, but in
+ * a session client, where fsu_sessiond provides them.
+ */
+static int
+fsu_io_init(void)
+{
+	struct lwp *mylwp, *l;
+	const char *p;
+	pid_t pid;
+	bool client;
+	int i, n;
+
+	n = FSU_IO_NTHREADS;
+	if ((p = getenv("FSU_IOTHREADS")) != NULL)
+		n = atoi(p);
+	if (n <= 0)
+		return -1;
+
+	fsu_io_threads = malloc(n * sizeof(pthread_t));
+	if (fsu_io_threads == NULL)
+		return -1;
+
+	client = fsu_session_client();
+	mylwp = client ? NULL : rump_pub_lwproc_curlwp();
+	pid = rump_sys_getpid();
+	for (i = 0; i < n; ++i) {
+		l = NULL;
+		if (!client) {
+			if (rump_pub_lwproc_newlwp(pid) != 0)
+				break;
+			l = rump_pub_lwproc_curlwp();
+			rump_pub_lwproc_switch(mylwp);
+		}
+
+		if (pthread_create(&fsu_io_threads[i], NULL, fsu_io_worker,
+		    l) != 0) {
+			if (l != NULL) {
+				rump_pub_lwproc_switch(l);
+				rump_pub_lwproc_releaselwp();
+				rump_pub_lwproc_switch(mylwp);
+			}
+			break;
+		}
+	}
+	if (i == 0) {
+		free(fsu_io_threads);
+		fsu_io_threads = NULL;
+		return -1;
+	}
+	fsu_io_nthreads = i;
+
+	/*
+	 * The lwps keep the rump process alive, they must be released
+	 * before fsu_unmount() which has been registered earlier.
+	 */
+	atexit(fsu_io_fini);
+	return 0;
+}
+
+/* Waits for the queued requests and stops the I/O threads */
+static void
+fsu_io_fini(void)
+{
+	int i;
+
+	pthread_mutex_lock(&fsu_io_lock);
+	fsu_io_exiting = true;
+	pthread_cond_broadcast(&fsu_io_cv);
+	pthread_mutex_unlock(&fsu_io_lock);
+
+	for (i = 0; i < fsu_io_nthreads; ++i)
+		pthread_join(fsu_io_threads[i], NULL);
+	free(fsu_io_threads);
+	fsu_io_threads = NULL;
+	fsu_io_nthreads = -1;
+}
+
+static void *
+fsu_io_worker(void *arg)
+{
+	struct fsu_ioreq *req;
+
+	if (arg != NULL)
+		rump_pub_lwproc_switch(arg);
+
+	pthread_mutex_lock(&fsu_io_lock);
+	for (;;) {
+		while (fsu_io_head == NULL && !fsu_io_exiting)
+			pthread_cond_wait(&fsu_io_cv, &fsu_io_lock);
+		if ((req = fsu_io_head) == NULL)
+			break;
+		if ((fsu_io_head = req->ior_next) == NULL)
+			fsu_io_tail = &fsu_io_head;
+		pthread_mutex_unlock(&fsu_io_lock);
+
+		fsu_io_run(req);
+
+		pthread_mutex_lock(&fsu_io_lock);
+		fsu_io_done(req);
+	}
+	pthread_mutex_unlock(&fsu_io_lock);
+
+	if (arg != NULL)
+		rump_pub_lwproc_releaselwp();
+	return NULL;
+}
+
+/* Completes a request, called with fsu_io_lock held */
+static void
+fsu_io_done(struct fsu_ioreq *req)
+{
+	struct fsu_iocq *cq;
+
+	req->ior_done = true;
+	if ((cq = req->ior_cq) != NULL) {
+		req->ior_next = NULL;
+		*cq->cq_tail = req;
+		cq->cq_tail = &req->ior_next;
+		--cq->cq_pending;
+		pthread_cond_signal(&cq->cq_cv);
+	}
+	pthread_cond_broadcast(&fsu_io_donecv);
+}
+
+static void
+fsu_io_run(struct fsu_ioreq *req)
+{
+	uint64_t t0;
+
+	t0 = fsu_stats_clock();
+	switch (req->ior_op) {
+	case FSU_IO_READ:
+		req->ior_rv = rump_sys_pread(req->ior_fd, req->ior_buf,
+		    req->ior_len, req->ior_off);
+		break;
+	case FSU_IO_WRITE:
+		req->ior_rv = rump_sys_pwrite(req->ior_fd, req->ior_buf,
+		    req->ior_len, req->ior_off);
+		break;
+	default:
+		req->ior_rv = -1;
+		errno = EINVAL;
+		break;
+	}
+	req->ior_errno = req->ior_rv == -1 ? errno : 0;
+	req->ior_ns = fsu_stats_clock() - t0;
+}
@@ -0,0 +1,75 @@
+/*
+ * Copyright (c) 2026 The fs-utils authors.  All Rights Reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS
+ * OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef _FSU_IO_H_
+#define _FSU_IO_H_
+
+#include <sys/types.h>
+
+#include <pthread.h>
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * I/O requests run on a pool of host threads bound to rump lwps of the
+ * calling process, so they share its descriptors and its root directory.
+ */
+
+#define FSU_IO_READ	(1)
+#define FSU_IO_WRITE	(2)
+
+struct fsu_iocq;
+
+struct fsu_ioreq {
+	struct fsu_ioreq *ior_next;	/* submission or completion queue */
+	struct fsu_iocq *ior_cq;	/* completion queue, may be NULL */
+	int ior_op;			/* FSU_IO_READ or FSU_IO_WRITE */
+	int ior_fd;			/* rump file descriptor */
+	void *ior_buf;			/* data */
+	size_t ior_len;			/* size of the transfer */
+	off_t ior_off;			/* offset in the file */
+	ssize_t ior_rv;			/* bytes transferred or -1 */
+	int ior_errno;			/* errno if ior_rv is -1 */
+	bool ior_done;			/* has the request completed */
+	uint64_t ior_ns;		/* time spent in the rump kernel */
+};
+
+/* Requests submitted with a completion queue are put there once done */
+struct fsu_iocq {
+	struct fsu_ioreq *cq_head;	/* completed requests */
+	struct fsu_ioreq **cq_tail;
+	int cq_pending;			/* requests not completed yet */
+	pthread_cond_t cq_cv;
+};
+
+void	fsu_io_submit(struct fsu_ioreq *);
+bool	fsu_io_wait(struct fsu_ioreq *);
+
+void	fsu_iocq_init(struct fsu_iocq *);
+void	fsu_iocq_destroy(struct fsu_iocq *);
+struct fsu_ioreq *fsu_iocq_get(struct fsu_iocq *, bool);
+
+#endif /* !_FSU_IO_H_ */
@@ -27,8 +27,10 @@
 
 #include "fs-utils.h"
 
+#include <sys/file.h>
 #include <sys/mount.h>
 #include <sys/stat.h>
+#include <sys/time.h>
 
 #if HAVE_NBCOMPAT_H
 #include <nbcompat.h>
@@ -50,14 +52,22 @@
 #include <fsu_utils.h>
 
 #include "fsu_mount.h"
+#include "fsu_stats.h"
 
 #include "filesystems.h"
 #include "fsu_alias.h"
+#include "fsu_probe.h"
 
-#define MOUNT_DIRECTORY "/mnt"
+#define MOUNT_DIRECTORY FSU_SESSION_MNT
 
 #define RUMPFSDEV "/dev/rumpfs"
 
+/* remote system calls library, preloaded in session clients */
+#define RUMPCLIENT_LIB "librumpclient.so"
+
+/* set in a session client once it has been executed again */
+#define SESSION_CLIENT_ENV "FSU_SESSION_CLIENT"
+
 #ifndef __UNCONST
 #define __UNCONST(a) ((char *)(unsigned long)(const char *)(a))
 #endif
@@ -91,12 +101,22 @@ struct mount_data_s {
 static int mount_alias(struct fsu_fsalias_s *, char *, char *,
     struct mount_data_s *, int);
 static int mount_fstype(fsu_fs_t *, const char *, char *, char *,
-    char *, struct mount_data_s *, int);
+    char *, struct mount_data_s *, int, bool);
 static int fsu_load_fs(const char *);
+static fsu_fs_t *probe_fs(const char *);
+static int session_attach(const char *, char *[]);
 
 static int mount_struct(_Bool, struct mount_data_s *);
+static void cache_mounted(const char *, const char *, bool);
 extern int rump_i_know_what_i_am_doing_with_sysents;
 
+/* the autodetected image and its type, cached again once unmounted */
+static char cache_image[PATH_MAX];
+static char cache_type[FSU_PROBE_TYPELEN];
+
+/* attached to a session, there is no local rump kernel */
+static bool session_client;
+
 /*
  * Tries to mount an image.
  * if the fstype is not given try every supported types.
@@ -107,33 +127,43 @@ fsu_mount(int *argc, char **argv[], int mode)
 	fsu_fs_t *fst;
 	struct fsu_fsalias_s *alias;
 	struct mount_data_s mntd;
-	int idx, fflag, rv, verbose;
+	int idx, fflag, nocache, rv, verbose;
 	int ch, stopopts;
 	char *mntopts, afsdev[PATH_MAX], *puffsexec, *specopts;
 	char *tmp;
 	char *fsdevice, *fstype;
 	struct stat sb;
+	uint64_t t0;
 #ifdef WITH_SYSPUFFS
-	const char options[] = GETOPT_PREFIX"f:o:p:s:t:v";
+	const char options[] = GETOPT_PREFIX"Cf:o:p:s:t:v";
 #else
-	const char options[] = GETOPT_PREFIX"f:o:s:t:v";
+	const char options[] = GETOPT_PREFIX"Cf:o:s:t:v";
 #endif
 
+	/* An image mounted by fsu_sessiond, no mount arguments. */
+	if ((tmp = getenv(FSU_SESSION_ENV)) != NULL && *tmp != '\0')
+		return session_attach(tmp, *argv);
+
 	alias = NULL;
 	fsdevice = fstype = mntopts = puffsexec = specopts = NULL;
 	fst = NULL;
-	verbose = fflag = 0;
+	verbose = fflag = nocache = 0;
 	stopopts = 0;
 	memset(&mntd, 0, sizeof(mntd));
 	mntd.mntd_fsdevice = mntd.mntd_canon_dev;
 
-	rump_init();
+	t0 = fsu_stats_clock();
+	rv = rump_init();
+	fsu_stats_phase("rump_init", NULL, t0, rv);
 	opterr = 0;
 	/*
 	 * [-o mnt_args] [-t fstype] [-p puffsexec] fsdevice
 	 */
 	while ((ch = getopt(*argc, *argv, options)) != -1) {
 		switch (ch) {
+		case 'C':
+			nocache = 1;
+			break;
 		case 'f':
 			if (fsdevice == NULL)
 				fsdevice = optarg;
@@ -235,7 +265,8 @@ fsu_mount(int *argc, char **argv[], int mode)
 	rv = 0;
 	if (!fflag) {
 		rv = -1;
-		build_alias_list();
+		t0 = fsu_stats_clock();
+		fsu_stats_phase("aliases", NULL, t0, build_alias_list());
 		alias = get_alias(fsdevice);
 		if (alias != NULL)
 			rv = mount_alias(alias, mntopts, specopts, &mntd,
@@ -253,8 +284,10 @@ fsu_mount(int *argc, char **argv[], int mode)
 			    fsdevice);
 			rv = -1;
 		} else {
+			t0 = fsu_stats_clock();
 			rv = rump_pub_etfs_register(RUMPFSDEV, fsdevice,
 			    RUMP_ETFS_BLK);
+			fsu_stats_phase("etfs_register", NULL, t0, rv);
 			if (rv != 0) {
 				warnx("%s: rump_pub_etfs_register failed "
 						"(error=%d)", fsdevice, rv);
@@ -262,7 +295,8 @@ fsu_mount(int *argc, char **argv[], int mode)
 				mntd.mntd_fsdevice = fsdevice;
 				fsdevice = strdup(RUMPFSDEV);
 				rv = mount_fstype(fst, fsdevice, mntopts,
-				    puffsexec, specopts, &mntd, verbose);
+				    puffsexec, specopts, &mntd, verbose,
+				    nocache);
 				if (rv == -1) {
 					warnx("%s: "
 					    "Invalid or unknown filesystem type"
@@ -301,9 +335,12 @@ fsu_mount(int *argc, char **argv[], int mode)
 
 static int
 mount_fstype(fsu_fs_t *fs, const char *fsdev, char *mntopts, char *puffsexec,
-    char *specopts, struct mount_data_s *mntdp, int verbose)
+    char *specopts, struct mount_data_s *mntdp, int verbose, bool nocache)
 {
-	int argvlen;
+	const char *probed[FSU_PROBE_MAX];
+	char cached[FSU_PROBE_TYPELEN];
+	uint64_t t0;
+	int argvlen, i, nprobed;
 
 	mntdp->mntd_fs = fs;
 	mntdp->mntd_argc = mntdp->mntd_flags = 0;
@@ -352,20 +389,106 @@ mount_fstype(fsu_fs_t *fs, const char *fsdev, char *mntopts, char *puffsexec,
 	if (fs != NULL)
 		return mount_struct(verbose, mntdp);
 
-	/* filesystem not given (auto detection) */
+	/*
+	 * filesystem not given (auto detection): try the type the image was
+	 * mounted as the last time, unless bypassed by -C or shown by -v,
+	 * then the types whose signature is in the image, then every other
+	 * type
+	 */
+	if (!nocache && !verbose) {
+		t0 = fsu_stats_clock();
+		i = fsu_probe_cached(mntdp->mntd_fsdevice, cached,
+		    sizeof(cached));
+		fsu_stats_phase("cache", i == 0 ? cached : NULL, t0, i);
+		if (i == 0 && (fs = probe_fs(cached)) != NULL) {
+			mntdp->mntd_flags = 0;
+			mntdp->mntd_fs = fs;
+			if (mount_struct(0, mntdp) == 0) {
+				cache_mounted(mntdp->mntd_fsdevice,
+				    fs->fs_name, true);
+				return 0;
+			}
+		}
+	}
+
+	t0 = fsu_stats_clock();
+	nprobed = fsu_probe(mntdp->mntd_fsdevice, probed, FSU_PROBE_MAX);
+	fsu_stats_phase("probe", NULL, t0, nprobed);
+	if (verbose) {
+		printf("Probed %s in %.3f ms:", mntdp->mntd_fsdevice,
+		    (fsu_stats_clock() - t0) / 1e6);
+		if (nprobed <= 0)
+			printf(" %s\n", nprobed == 0 ? "no match" : "failed");
+		else {
+			for (i = 0; i < nprobed; i++)
+				printf(" %s", probed[i]);
+			printf("\n");
+		}
+	}
+	for (i = 0; i < nprobed; i++) {
+		if ((fs = probe_fs(probed[i])) == NULL)
+			continue;
+		if (verbose)
+			printf("Trying with fs %s\n", fs->fs_name);
+		mntdp->mntd_flags = 0;
+		mntdp->mntd_fs = fs;
+		if (mount_struct(verbose > 1, mntdp) == 0) {
+			if (!nocache)
+				cache_mounted(mntdp->mntd_fsdevice,
+				    fs->fs_name, false);
+			return 0;
+		}
+	}
+
 	for (fs = fslist; fs->fs_name != NULL; ++fs) {
+		for (i = 0; i < nprobed; i++)
+			if (strcmp(fs->fs_name, probed[i]) == 0)
+				break;
+		if (i < nprobed)
+			continue;
 		if (verbose)
 			printf("Trying with fs %s\n", fs->fs_name);
 		if (fs->fs_flags & FS_NO_AUTO)
 			continue;
 		mntdp->mntd_flags = 0;
 		mntdp->mntd_fs = fs;
-		if (mount_struct(verbose > 1, mntdp) == 0)
+		if (mount_struct(verbose > 1, mntdp) == 0) {
+			if (!nocache)
+				cache_mounted(mntdp->mntd_fsdevice,
+				    fs->fs_name, false);
 			return 0;
+		}
 	}
 	return -1;
 }
 
+/*
+ * Remembers the autodetected type of the image, and caches it unless it
+ * was found in the cache.  fsu_unmount caches it again if the image was
+ * modified while mounted.
+ */
+static void
+cache_mounted(const char *image, const char *type, bool hit)
+{
+
+	if (!hit)
+		fsu_probe_cache(image, type);
+	strlcpy(cache_image, image, sizeof(cache_image));
+	strlcpy(cache_type, type, sizeof(cache_type));
+}
+
+/* Returns the fslist entry of a probed type, if it can be autodetected */
+static fsu_fs_t *
+probe_fs(const char *name)
+{
+	fsu_fs_t *fs;
+
+	for (fs = fslist; fs->fs_name != NULL; ++fs)
+		if (strcmp(fs->fs_name, name) == 0)
+			return FSU_ISDISKFS(fs) ? fs : NULL;
+	return NULL;
+}
+
 static int
 mount_alias(struct fsu_fsalias_s *al, char *mntopts, char *specopts,
     struct mount_data_s *mntdp, int verbose)
@@ -435,6 +558,7 @@ static int
 mount_struct(_Bool verbose, struct mount_data_s *mntdp)
 {
 	fsu_fs_t *fs;
+	uint64_t t0;
 	int rv;
 
 	fs = mntdp->mntd_fs;
@@ -460,8 +584,11 @@ mount_struct(_Bool verbose, struct mount_data_s *mntdp)
 	rv = fsu_load_fs(fs->fs_name);
 
 	if (rv == 0) {
+		t0 = fsu_stats_clock();
 		rv = rump_sys_mount(fs->fs_name, mntdp->mntd_canon_dir,
 		    mntdp->mntd_flags, fs->fs_args, fs->fs_args_size);
+		fsu_stats_phase("mount", fs->fs_name, t0,
+		    rv == 0 ? 0 : errno);
 #if 0
 		/*
 		 * This will result in a lot of spam for fs type autodetection,
@@ -474,12 +601,18 @@ mount_struct(_Bool verbose, struct mount_data_s *mntdp)
 
 	if (rv == 0) {
 		/* fork a rump kernel process to chroot() to the mountpoint */
-		if ((rv = rump_pub_lwproc_rfork(RUMP_RFCFDG)) != 0) {
+		t0 = fsu_stats_clock();
+		rv = rump_pub_lwproc_rfork(RUMP_RFCFDG);
+		fsu_stats_phase("rfork", NULL, t0, rv);
+		if (rv != 0) {
 			warnx("fork failed!");
 			rump_sys_unmount(MOUNT_DIRECTORY, 0);
 		} else {
+			fsu_stats_atexit();
 			atexit(fsu_unmount);
-			rump_sys_chroot(MOUNT_DIRECTORY);
+			t0 = fsu_stats_clock();
+			fsu_stats_phase("chroot", NULL, t0,
+			    rump_sys_chroot(MOUNT_DIRECTORY) == 0 ? 0 : errno);
 		}
 	}
 #ifdef WITH_SMBFS
@@ -498,9 +631,136 @@ mount_struct(_Bool verbose, struct mount_data_s *mntdp)
 	return rv;
 }
 
+/*
+ * Attaches to the image mounted by the fsu_sessiond serving the socket
+ * path.  The rump system calls of the program have to go to the server:
+ * the program is executed again with librumpclient preloaded, whose
+ * rump_sys_* functions take precedence over the ones of the local rump
+ * kernel, as rumphijack does.  The client holds a shared lock on the lock
+ * file of the session until it exits, so the server does not time out or
+ * unmount under it.
+ */
+static int
+session_attach(const char *path, char *argv[])
+{
+	char url[PATH_MAX + 8], lock[PATH_MAX], *preload, *tmp;
+	int (*clinit)(void);
+	struct stat sb;
+	uint64_t t0;
+	void *self;
+	int fd, rv;
+
+#ifdef NO_COMPONENT_DLOPEN
+	warnx("%s: sessions need a dynamically linked fs-utils", path);
+	return -1;
+#endif
+	snprintf(lock, sizeof(lock), "%s%s", path, FSU_SESSION_LOCK);
+
+	if (getenv(SESSION_CLIENT_ENV) == NULL) {
+		snprintf(url, sizeof(url), "unix://%s", path);
+		preload = getenv("LD_PRELOAD");
+		if (preload == NULL || *preload == '\0')
+			tmp = strdup(RUMPCLIENT_LIB);
+		else if ((tmp = malloc(strlen(preload) +
+		    sizeof(RUMPCLIENT_LIB) + 1)) != NULL)
+			sprintf(tmp, "%s:%s", RUMPCLIENT_LIB, preload);
+		if (tmp == NULL) {
+			warn(NULL);
+			return -1;
+		}
+		if (setenv("RUMP_SERVER", url, 1) == -1 ||
+		    setenv("LD_PRELOAD", tmp, 1) == -1 ||
+		    setenv(SESSION_CLIENT_ENV, "1", 1) == -1) {
+			warn("setenv");
+			free(tmp);
+			return -1;
+		}
+		free(tmp);
+#ifdef __linux__
+		execv("/proc/self/exe", argv);
+#endif
+		execvp(argv[0], argv);
+		warn("%s", argv[0]);
+		return -1;
+	}
+
+	/*
+	 * A server exiting holds the lock exclusively and removes the file
+	 * before releasing it.
+	 */
+	if ((fd = open(lock, O_RDONLY)) == -1) {
+		warn("%s: no session", path);
+		return -1;
+	}
+	if (flock(fd, LOCK_SH) == -1 || fstat(fd, &sb) == -1) {
+		warn("%s", lock);
+		close(fd);
+		return -1;
+	}
+	if (sb.st_nlink == 0) {
+		warnx("%s: session closed", path);
+		close(fd);
+		return -1;
+	}
+	(void)futimes(fd, NULL);
+
+	if ((self = dlopen(NULL, RTLD_NOW)) == NULL ||
+	    (clinit = (int (*)(void))dlsym(self, "rumpclient_init")) == NULL) {
+		warnx("%s: %s not loaded", path, RUMPCLIENT_LIB);
+		close(fd);
+		return -1;
+	}
+	t0 = fsu_stats_clock();
+	rv = clinit();
+	fsu_stats_phase("rumpclient_init", NULL, t0, rv == 0 ? 0 : errno);
+	if (rv == -1) {
+		warn("%s", path);
+		close(fd);
+		return -1;
+	}
+	t0 = fsu_stats_clock();
+	rv = rump_sys_chroot(MOUNT_DIRECTORY);
+	fsu_stats_phase("chroot", NULL, t0, rv == 0 ? 0 : errno);
+	if (rv == -1) {
+		warn("%s: chroot", path);
+		close(fd);
+		return -1;
+	}
+	fsu_stats_atexit();
+	session_client = true;
+
+	optind = 1;
+#ifdef HAVE_GETOPT_OPTRESET
+	optreset = 1;
+#endif
+	opterr = 1;
+	return 0;
+}
+
+/*
+ * Tells whether the program is a session client.  Its rump system calls
+ * go to fsu_sessiond, which gives each calling thread an lwp; the local
+ * rump kernel is not initialized and its lwproc interface must not be
+ * used.
+ */
+bool
+fsu_session_client(void)
+{
+
+	return session_client;
+}
+
+/* unmount attempts while the file system is busy, 100ms apart */
+#define UNMOUNT_TRIES	50
+
 void
 fsu_unmount(void)
 {
+	char type[FSU_PROBE_TYPELEN];
+	uint64_t t0;
+	int i;
+
+	t0 = fsu_stats_clock();
 
 	/*
 	 * Release the emulated process.  This:
@@ -508,8 +768,21 @@ fsu_unmount(void)
 	 *   2) gives us a native process context so we can umount()
 	 */
 	rump_pub_lwproc_releaselwp();
-	if (rump_sys_unmount(MOUNT_DIRECTORY, 0) != 0)
-		warnx("unmount failed, image may be dirty!");
+
+	/* The processes of session clients may still be going away. */
+	for (i = 0; rump_sys_unmount(MOUNT_DIRECTORY, 0) != 0; i++) {
+		if (errno != EBUSY || i == UNMOUNT_TRIES) {
+			fsu_stats_phase("unmount", NULL, t0, errno);
+			warnx("unmount failed, image may be dirty!");
+			return;
+		}
+		usleep(100000);
+	}
+	fsu_stats_phase("unmount", NULL, t0, 0);
+
+	if (cache_type[0] != '\0' &&
+	    fsu_probe_cached(cache_image, type, sizeof(type)) == -1)
+		fsu_probe_cache(cache_image, cache_type);
 }
 
 const char *
@@ -532,18 +805,23 @@ fsu_load_fs(const char *fsname)
 	char fname[PATH_MAX + 1];
 	void *handle;
 	const struct modinfo *const *mi_start, *const *mi_end;
+	uint64_t t0;
 	int error;
 
 	snprintf(fname, sizeof(fname) - 1, "librumpfs_%s.so", fsname);
+	t0 = fsu_stats_clock();
 	handle = dlopen(fname, RTLD_LAZY|RTLD_GLOBAL);
+	fsu_stats_phase("dlopen", fsname, t0, handle == NULL ? -1 : 0);
 	if (handle == NULL)
 		return -1;
 
 	mi_start = dlsym(handle, "__start_link_set_modules");
 	mi_end = dlsym(handle, "__stop_link_set_modules");
 	if (mi_start && mi_end) {
+		t0 = fsu_stats_clock();
 		error = rump_pub_module_init(mi_start,
 		    (size_t)(mi_end-mi_start));
+		fsu_stats_phase("module_init", fsname, t0, error);
 		if (error)
 			goto errclose;
 		return 0;
@@ -29,12 +29,19 @@
 #define _FSU_MOUNT_H_
 
 #include <errno.h>
+#include <stdbool.h>
 
 #define MOUNT_READWRITE 0
 #define MOUNT_READONLY 1
 
+/* fsu_sessiond, see fsu_mount(3) */
+#define FSU_SESSION_ENV "FSU_SESSION"	/* socket of the session */
+#define FSU_SESSION_LOCK ".lock"	/* suffix of its lock file */
+#define FSU_SESSION_MNT "/mnt"		/* where the image is mounted */
+
 int		fsu_mount(int *, char **[], int);
 const char	*fsu_mount_usage(void);
 void		fsu_unmount(void);
+bool		fsu_session_client(void);
 
 #endif
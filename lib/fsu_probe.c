@@ -0,0 +1,402 @@
+/*
+ * Copyright (c) 2026 The fs-utils authors.  All Rights Reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS
+ * OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include "fs-utils.h"
+
+#include <sys/types.h>
+#include <sys/mount.h>
+#include <sys/stat.h>
+
+#include <fcntl.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "nb_fs.h"
+#include "fsu_probe.h"
+
+/*
+ * Guesses the file system of an image from the signatures found at fixed
+ * offsets: superblock magic numbers, boot sector and volume descriptor
+ * identifiers.  The image is read on the host, so that no file system
+ * component needs to be loaded to probe it.  All the signatures used are
+ * in the first PROBE_SIZE bytes, except the FFS superblock kept at 256k
+ * for the images made by older newfs.
+ */
+#define PROBE_SIZE	(68 * 1024)
+#define PROBE_PIGGY	(256 * 1024)	/* SBLOCK_PIGGY */
+
+/* big and little endian 16 and 32 bits values */
+#define BE16(p)	((uint16_t)((p)[0] << 8 | (p)[1]))
+#define LE16(p)	((uint16_t)((p)[1] << 8 | (p)[0]))
+#define BE32(p)	((uint32_t)(p)[0] << 24 | (uint32_t)(p)[1] << 16 |	\
+		 (uint32_t)(p)[2] << 8 | (uint32_t)(p)[3])
+#define LE32(p)	((uint32_t)(p)[3] << 24 | (uint32_t)(p)[2] << 16 |	\
+		 (uint32_t)(p)[1] << 8 | (uint32_t)(p)[0])
+
+/* 32 bits magic number in either byte order */
+#define MAGIC32(p, m)	(BE32(p) == (m) || LE32(p) == (m))
+
+#define FFS_MAGIC_OFF	1372		/* fs_magic in struct fs */
+#define FS_UFS1_MAGIC	0x011954
+#define FS_UFS2_MAGIC	0x19540119
+#define LFS_SBOFF	8192		/* LFS_LABELPAD */
+#define LFS_MAGIC	0x070162
+#define LFS64_MAGIC	0x19620701
+#define EXT2_SBOFF	1024
+#define EXT2_MAGIC_OFF	56		/* s_magic in struct ext2fs */
+#define EXT2_MAGIC	0xef53
+#define EFS_SBOFF	512
+#define EFS_MAGIC_OFF	28		/* sb_magic in struct efs_sb */
+#define EFS_MAGIC	0x072959
+#define EFS_NEWMAGIC	0x07295a
+#define BFS_MAGIC	0x1badface
+#define HFS_SBOFF	1024
+#define HFS_EMBED_OFF	0x7c		/* drEmbedSigWord in the HFS MDB */
+#define ISO_VDOFF	32768		/* first volume descriptor */
+#define ISO_VDSIZE	2048
+#define ISO_NVD		16		/* descriptors looked at */
+
+static bool
+probe_ffs(const uint8_t *buf, const uint8_t *piggy)
+{
+	static const size_t sboff[] = { 65536, 8192, 0 };
+	const uint8_t *p;
+	size_t i;
+
+	for (i = 0; i < sizeof(sboff) / sizeof(sboff[0]); i++) {
+		p = buf + sboff[i] + FFS_MAGIC_OFF;
+		if (MAGIC32(p, FS_UFS1_MAGIC) || MAGIC32(p, FS_UFS2_MAGIC))
+			return true;
+	}
+	p = piggy;
+	return MAGIC32(p, FS_UFS1_MAGIC) || MAGIC32(p, FS_UFS2_MAGIC);
+}
+
+static bool
+probe_lfs(const uint8_t *buf)
+{
+	const uint8_t *p;
+
+	p = buf + LFS_SBOFF;
+	return MAGIC32(p, LFS_MAGIC) || MAGIC32(p, LFS64_MAGIC);
+}
+
+static bool
+probe_ext2fs(const uint8_t *buf)
+{
+
+	return LE16(buf + EXT2_SBOFF + EXT2_MAGIC_OFF) == EXT2_MAGIC;
+}
+
+static bool
+probe_efs(const uint8_t *buf)
+{
+	const uint8_t *p;
+
+	p = buf + EFS_SBOFF + EFS_MAGIC_OFF;
+	return BE32(p) == EFS_MAGIC || BE32(p) == EFS_NEWMAGIC;
+}
+
+static bool
+probe_sysvbfs(const uint8_t *buf)
+{
+
+	return MAGIC32(buf, BFS_MAGIC);
+}
+
+/* HFS+, or HFS+ wrapped in an HFS volume */
+static bool
+probe_hfs(const uint8_t *buf)
+{
+	const uint8_t *p;
+
+	p = buf + HFS_SBOFF;
+	if (memcmp(p, "H+", 2) == 0 || memcmp(p, "HX", 2) == 0)
+		return true;
+	return memcmp(p, "BD", 2) == 0 &&
+	    memcmp(p + HFS_EMBED_OFF, "H+", 2) == 0;
+}
+
+static bool
+probe_ntfs(const uint8_t *buf)
+{
+
+	return memcmp(buf + 3, "NTFS    ", 8) == 0;
+}
+
+/*
+ * A FAT boot sector: a jump, a sane sector size and the 0x55aa signature.
+ * NTFS and exFAT boot sectors look the same but have their own OEM name.
+ */
+static bool
+probe_msdos(const uint8_t *buf)
+{
+	uint16_t bps;
+
+	if (buf[0] != 0xeb && buf[0] != 0xe9)
+		return false;
+	if (buf[510] != 0x55 || buf[511] != 0xaa)
+		return false;
+	if (probe_ntfs(buf) || memcmp(buf + 3, "EXFAT   ", 8) == 0)
+		return false;
+	bps = LE16(buf + 11);
+	return bps >= 512 && bps <= 4096 && (bps & (bps - 1)) == 0;
+}
+
+static bool
+probe_cd9660(const uint8_t *buf)
+{
+	int i;
+
+	for (i = 0; i < ISO_NVD; i++)
+		if (memcmp(buf + ISO_VDOFF + i * ISO_VDSIZE + 1, "CD001",
+		    5) == 0)
+			return true;
+	return false;
+}
+
+/* An NSR descriptor in the volume recognition sequence. */
+static bool
+probe_udf(const uint8_t *buf)
+{
+	const uint8_t *p;
+	int i;
+
+	for (i = 0; i < ISO_NVD; i++) {
+		p = buf + ISO_VDOFF + i * ISO_VDSIZE + 1;
+		if (memcmp(p, "NSR02", 5) == 0 || memcmp(p, "NSR03", 5) == 0)
+			return true;
+	}
+	return false;
+}
+
+/*
+ * The probes in the order their types are returned.  Fixed magic numbers
+ * come before the weaker boot sector check of msdos.  cd9660 comes before
+ * udf as in fslist, so a UDF bridge disc is mounted as cd9660 as it was by
+ * trial mounting.
+ */
+static const struct {
+	const char *pr_name;
+	bool (*pr_probe)(const uint8_t *);
+} probes[] = {
+	{ MOUNT_LFS,	 probe_lfs },
+	{ MOUNT_EXT2FS,	 probe_ext2fs },
+	{ MOUNT_EFS,	 probe_efs },
+	{ MOUNT_SYSVBFS, probe_sysvbfs },
+	{ MOUNT_HFS,	 probe_hfs },
+	{ MOUNT_NTFS,	 probe_ntfs },
+	{ MOUNT_CD9660,	 probe_cd9660 },
+	{ MOUNT_UDF,	 probe_udf },
+	{ MOUNT_MSDOS,	 probe_msdos },
+};
+
+/*
+ * Fills types with up to ntypes names of the file systems the image path
+ * looks like, most likely first.  Returns how many, 0 if none matched,
+ * or -1 if the image could not be read.
+ */
+int
+fsu_probe(const char *path, const char **types, int ntypes)
+{
+	uint8_t buf[PROBE_SIZE], piggy[4];
+	ssize_t rd;
+	size_t i;
+	int fd, n;
+
+	if ((fd = open(path, O_RDONLY)) == -1)
+		return -1;
+	memset(buf, 0, sizeof(buf));
+	memset(piggy, 0, sizeof(piggy));
+	rd = pread(fd, buf, sizeof(buf), 0);
+	if (rd != -1 && (size_t)rd == sizeof(buf))
+		rd = pread(fd, piggy, sizeof(piggy),
+		    PROBE_PIGGY + FFS_MAGIC_OFF);
+	close(fd);
+	if (rd == -1)
+		return -1;
+
+	n = 0;
+	if (n < ntypes && probe_ffs(buf, piggy))
+		types[n++] = MOUNT_FFS;
+	for (i = 0; i < sizeof(probes) / sizeof(probes[0]) && n < ntypes; i++)
+		if (probes[i].pr_probe(buf))
+			types[n++] = probes[i].pr_name;
+	return n;
+}
+
+/*
+ * The autodetection cache, $HOME/.fsu_cache or FSU_CACHE, keeps the type
+ * the last images were mounted as.  Each line holds the device, inode,
+ * size, modification and change times of an image, the type and the
+ * path.  An image which is modified or replaced no longer matches its
+ * line, and the line is replaced when the image is mounted again.  The
+ * file is rewritten and renamed over the old one, so that concurrent
+ * programs read either of them.
+ */
+#define CACHE_FILE	".fsu_cache"
+#define CACHE_MAX	64		/* images remembered */
+
+struct cache_ent {
+	uintmax_t ce_dev, ce_ino;
+	intmax_t ce_size, ce_mtime, ce_ctime;
+	char ce_type[FSU_PROBE_TYPELEN];
+	char ce_path[PATH_MAX];
+};
+
+/* The path of the cache, false if it is disabled. */
+static bool
+cache_file(char *file, size_t len)
+{
+	const char *env;
+
+	if ((env = getenv("FSU_CACHE")) != NULL) {
+		if (*env == '\0')
+			return false;
+		return (size_t)snprintf(file, len, "%s", env) < len;
+	}
+	if ((env = getenv("HOME")) == NULL)
+		return false;
+	return (size_t)snprintf(file, len, "%s/%s", env, CACHE_FILE) < len;
+}
+
+static bool
+cache_parse(char *line, struct cache_ent *ce)
+{
+	int off;
+
+	line[strcspn(line, "\n")] = '\0';
+	off = 0;
+	if (sscanf(line, "%ju %ju %jd %jd %jd %15s %n", &ce->ce_dev,
+	    &ce->ce_ino, &ce->ce_size, &ce->ce_mtime, &ce->ce_ctime,
+	    ce->ce_type, &off) != 6 || off == 0 || line[off] == '\0')
+		return false;
+	return strlcpy(ce->ce_path, line + off, sizeof(ce->ce_path)) <
+	    sizeof(ce->ce_path);
+}
+
+static void
+cache_key(const char *path, const struct stat *sb, struct cache_ent *ce)
+{
+
+	ce->ce_dev = sb->st_dev;
+	ce->ce_ino = sb->st_ino;
+	ce->ce_size = sb->st_size;
+	ce->ce_mtime = sb->st_mtime;
+	ce->ce_ctime = sb->st_ctime;
+	strlcpy(ce->ce_path, path, sizeof(ce->ce_path));
+}
+
+static bool
+cache_match(const struct cache_ent *a, const struct cache_ent *b)
+{
+
+	return a->ce_dev == b->ce_dev && a->ce_ino == b->ce_ino &&
+	    a->ce_size == b->ce_size && a->ce_mtime == b->ce_mtime &&
+	    a->ce_ctime == b->ce_ctime && strcmp(a->ce_path, b->ce_path) == 0;
+}
+
+/*
+ * Copies to type the type the image path was last mounted as, if it has
+ * not changed since.  Returns 0, or -1 if it is not in the cache.
+ */
+int
+fsu_probe_cached(const char *path, char *type, size_t len)
+{
+	char file[PATH_MAX], line[PATH_MAX + 128];
+	struct cache_ent ce, key;
+	struct stat sb;
+	FILE *fp;
+	int rv;
+
+	if (!cache_file(file, sizeof(file)) || stat(path, &sb) == -1)
+		return -1;
+	if ((fp = fopen(file, "r")) == NULL)
+		return -1;
+	cache_key(path, &sb, &key);
+	rv = -1;
+	while (fgets(line, sizeof(line), fp) != NULL) {
+		if (cache_parse(line, &ce) && cache_match(&ce, &key)) {
+			if (strlcpy(type, ce.ce_type, len) < len)
+				rv = 0;
+			break;
+		}
+	}
+	fclose(fp);
+	return rv;
+}
+
+/*
+ * Records that the image path was mounted as type, in place of the line
+ * of the image, keeping the CACHE_MAX - 1 most recent other ones.
+ */
+void
+fsu_probe_cache(const char *path, const char *type)
+{
+	char file[PATH_MAX], tmp[PATH_MAX], line[PATH_MAX + 128];
+	struct cache_ent ce;
+	struct stat sb;
+	FILE *in, *out;
+	int fd, n;
+
+	if (!cache_file(file, sizeof(file)) || stat(path, &sb) == -1 ||
+	    strlen(type) >= sizeof(ce.ce_type) ||
+	    strpbrk(path, "\n") != NULL)
+		return;
+	if ((size_t)snprintf(tmp, sizeof(tmp), "%s.%ld", file,
+	    (long)getpid()) >= sizeof(tmp))
+		return;
+	if ((fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0644)) == -1)
+		return;
+	if ((out = fdopen(fd, "w")) == NULL) {
+		close(fd);
+		unlink(tmp);
+		return;
+	}
+
+	cache_key(path, &sb, &ce);
+	fprintf(out, "%ju %ju %jd %jd %jd %s %s\n", ce.ce_dev, ce.ce_ino,
+	    ce.ce_size, ce.ce_mtime, ce.ce_ctime, type, ce.ce_path);
+	if ((in = fopen(file, "r")) != NULL) {
+		for (n = 1; n < CACHE_MAX && fgets(line, sizeof(line), in) !=
+		    NULL;) {
+			if (!cache_parse(line, &ce) ||
+			    strcmp(ce.ce_path, path) == 0)
+				continue;
+			fprintf(out, "%ju %ju %jd %jd %jd %s %s\n", ce.ce_dev,
+			    ce.ce_ino, ce.ce_size, ce.ce_mtime, ce.ce_ctime,
+			    ce.ce_type, ce.ce_path);
+			++n;
+		}
+		fclose(in);
+	}
+	if (fclose(out) != 0 || rename(tmp, file) == -1)
+		unlink(tmp);
+}
@@ -0,0 +1,773 @@
+/*
+ * Copyright (c) 2026 The fs-utils authors.  All Rights Reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS
+ * OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include "fs-utils.h"
+
+#include <sys/stat.h>
+
+#include <dirent.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <rump/rump.h>
+#include <rump/rump_syscalls.h>
+#include <rump/rumpdefs.h>
+
+#include <fsu_utils.h>
+#include <fsu_mount.h>
+
+/*
+ * Parallel walk of a file hierarchy.  Directories are read by a pool of
+ * host threads bound to rump lwps of the calling process, or to those
+ * fsu_sessiond gives them in a session client.  Each thread
+ * has a deque of directories to read: it pushes the subdirectories it
+ * finds and takes back the last one pushed, so it goes depth first, and
+ * a thread without work steals the oldest directory of another one,
+ * usually the biggest subtree left.  Entries are stat'ed relative to the
+ * directory being read.
+ *
+ * Without FSU_PWALK_ORDERED, the threads call back for the entries as
+ * they read them.  With it, they keep the entries of each directory and
+ * the calling thread calls back in the order of a serial pre-order walk,
+ * waiting for the directories not read yet.
+ */
+
+/* default and highest number of threads, FSU_WALKTHREADS overrides it */
+#define	FSU_PWALK_MAXTHREADS	(64)
+
+/* directory entries read at once */
+#define	FSU_PWALK_NBATCH	(128)
+
+/* initial size of the deques, a power of 2 */
+#define	FSU_PWALK_DQSIZE	(64)
+
+struct fsu_pwnode;
+
+/* A directory to read */
+struct fsu_pwdir {
+	char *pd_path;
+	size_t pd_pathlen;
+	int pd_level;			/* of its entries */
+	dev_t pd_dev;
+	int pd_errno;			/* if it could not be read */
+	bool pd_done;			/* has been read, or dropped */
+	bool pd_skip;			/* don't read it */
+
+	/* Kept for the calling thread with FSU_PWALK_ORDERED */
+	struct fsu_pwnode *pd_nodes;
+	size_t pd_nnodes, pd_nodesize;
+	char *pd_names;			/* nul terminated names */
+	size_t pd_nameslen, pd_namesize;
+};
+
+/* An entry of a directory read with FSU_PWALK_ORDERED */
+struct fsu_pwnode {
+	size_t pn_name;			/* offset in pd_names */
+	int pn_type;
+	int pn_errno;
+	bool pn_stated;
+	struct stat pn_st;
+	struct fsu_pwdir *pn_dir;	/* if it is to be read */
+};
+
+struct fsu_pwdeque {
+	pthread_mutex_t dq_lock;
+	struct fsu_pwdir **dq_tab;
+	size_t dq_size;			/* a power of 2 */
+	size_t dq_top;			/* next one stolen */
+	size_t dq_bot;			/* next one pushed */
+};
+
+struct fsu_pwalk {
+	fsu_pwalk_cb pw_cb;
+	void *pw_arg;
+	int pw_flags;
+	dev_t pw_dev;			/* of the root, for FSU_PWALK_XDEV */
+
+	struct fsu_pwdeque *pw_deques;
+	int pw_nthreads;
+
+	pthread_mutex_t pw_lock;	/* protects what follows */
+	pthread_cond_t pw_workcv;	/* work pushed, or all done */
+	pthread_cond_t pw_donecv;	/* a directory has been read */
+	unsigned pw_active;		/* directories queued or being read */
+	unsigned pw_idle;		/* threads waiting for work */
+	uint64_t pw_gen;		/* counts pushes */
+	int pw_rv;			/* non-zero return of the callback */
+};
+
+struct fsu_pwthread {
+	struct fsu_pwalk *pt_pw;
+	int pt_id;
+	struct lwp *pt_lwp;
+	pthread_t pt_thread;
+	char *pt_path;			/* path of the entries called back */
+	size_t pt_pathsize;
+};
+
+static int	fsu_pwalk_nthreads(void);
+static void	*fsu_pwalk_worker(void *);
+static void	fsu_pwalk_loop(struct fsu_pwalk *, struct fsu_pwthread *);
+static void	fsu_pwalk_read(struct fsu_pwalk *, struct fsu_pwthread *,
+		    struct fsu_pwdir *);
+static int	fsu_pwalk_push(struct fsu_pwalk *, int, struct fsu_pwdir *);
+static struct fsu_pwdir *fsu_pwalk_pop(struct fsu_pwdeque *);
+static struct fsu_pwdir *fsu_pwalk_steal(struct fsu_pwdeque *);
+static struct fsu_pwdir *fsu_pwalk_newdir(const char *, size_t, const char *,
+		    size_t, int, dev_t);
+static void	fsu_pwalk_freedir(struct fsu_pwdir *);
+static int	fsu_pwalk_deliver(struct fsu_pwalk *, struct fsu_pwthread *,
+		    struct fsu_pwdir *);
+static void	fsu_pwalk_discard(struct fsu_pwalk *, struct fsu_pwdir *);
+static void	fsu_pwalk_wait(struct fsu_pwalk *, struct fsu_pwdir *);
+static int	fsu_pwalk_call(struct fsu_pwalk *, struct fsu_pwthread *,
+		    const char *, size_t, const char *, size_t, int, int,
+		    const struct stat *, int);
+static int	fsu_pwalk_stop(struct fsu_pwalk *, int);
+static bool	fsu_pwalk_stopped(struct fsu_pwalk *);
+
+/*
+ * Walks the hierarchy under root, calling cb for each file.  Returns 0
+ * at the end of the walk, the first value other than 0 and
+ * FSU_PWALK_SKIP returned by cb, or -1 with errno set if the walk could
+ * not be started.
+ */
+int
+fsu_pwalk(const char *root, int flags, int nthreads, fsu_pwalk_cb cb,
+    void *arg)
+{
+	struct fsu_pwalk pw;
+	struct fsu_pwthread *pt, self;
+	struct fsu_pwdir *d;
+	struct stat st;
+	struct lwp *mylwp;
+	size_t len;
+	pid_t pid;
+	bool client;
+	int i, n, rv;
+
+	if (root == NULL || *root == '\0' || cb == NULL ||
+	    (flags & ~FSU_PWALK_MASK) != 0) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	memset(&pw, 0, sizeof(pw));
+	memset(&self, 0, sizeof(self));
+	pw.pw_cb = cb;
+	pw.pw_arg = arg;
+	pw.pw_flags = flags;
+	pthread_mutex_init(&pw.pw_lock, NULL);
+	pthread_cond_init(&pw.pw_workcv, NULL);
+	pthread_cond_init(&pw.pw_donecv, NULL);
+	self.pt_pw = &pw;
+
+	/* The root is followed if it is a symbolic link. */
+	len = strlen(root);
+	if (rump_sys_stat(root, &st) == -1) {
+		rv = fsu_pwalk_call(&pw, &self, root, len, NULL, 0, 0,
+		    DT_UNKNOWN, NULL, errno);
+		if (rv == FSU_PWALK_SKIP)
+			rv = 0;
+		goto out;
+	}
+	pw.pw_dev = st.st_dev;
+	rv = fsu_pwalk_call(&pw, &self, root, len, NULL, 0, 0,
+	    S_ISDIR(st.st_mode) ? DT_DIR : IFTODT(st.st_mode), &st, 0);
+	if (rv == FSU_PWALK_SKIP || (rv == 0 && !S_ISDIR(st.st_mode))) {
+		rv = 0;
+		goto out;
+	}
+	if (rv != 0 || (rv = pw.pw_rv) != 0)
+		goto out;
+
+	if ((d = fsu_pwalk_newdir(root, len, NULL, 0, 1, st.st_dev)) == NULL) {
+		rv = -1;
+		goto out;
+	}
+
+	if (nthreads <= 0)
+		nthreads = fsu_pwalk_nthreads();
+	if (nthreads > FSU_PWALK_MAXTHREADS)
+		nthreads = FSU_PWALK_MAXTHREADS;
+
+	pw.pw_deques = calloc(nthreads, sizeof(*pw.pw_deques));
+	pt = calloc(nthreads, sizeof(*pt));
+	if (pw.pw_deques == NULL || pt == NULL) {
+		free(pw.pw_deques);
+		free(pt);
+		fsu_pwalk_freedir(d);
+		rv = -1;
+		goto out;
+	}
+	for (i = 0; i < nthreads; ++i)
+		pthread_mutex_init(&pw.pw_deques[i].dq_lock, NULL);
+	pw.pw_nthreads = nthreads;
+
+	if (fsu_pwalk_push(&pw, 0, d) != 0) {
+		rv = -1;
+		fsu_pwalk_freedir(d);
+		goto fini;
+	}
+
+	/*
+	 * Each thread gets a new lwp in the rump process of the caller,
+	 * unless it is a session client.
+	 */
+	client = fsu_session_client();
+	mylwp = client ? NULL : rump_pub_lwproc_curlwp();
+	pid = rump_sys_getpid();
+	for (n = 0; n < nthreads; ++n) {
+		pt[n].pt_pw = &pw;
+		pt[n].pt_id = n;
+		if (!client) {
+			if (rump_pub_lwproc_newlwp(pid) != 0)
+				break;
+			pt[n].pt_lwp = rump_pub_lwproc_curlwp();
+			rump_pub_lwproc_switch(mylwp);
+		}
+
+		if (pthread_create(&pt[n].pt_thread, NULL, fsu_pwalk_worker,
+		    &pt[n]) != 0) {
+			if (pt[n].pt_lwp != NULL) {
+				rump_pub_lwproc_switch(pt[n].pt_lwp);
+				rump_pub_lwproc_releaselwp();
+				rump_pub_lwproc_switch(mylwp);
+			}
+			break;
+		}
+	}
+
+	/* Without threads, the walk is done here before calling back. */
+	if (n == 0) {
+		self.pt_id = 0;
+		fsu_pwalk_loop(&pw, &self);
+	}
+
+	rv = 0;
+	if (flags & FSU_PWALK_ORDERED)
+		rv = fsu_pwalk_deliver(&pw, &self, d);
+
+	for (i = 0; i < n; ++i) {
+		pthread_join(pt[i].pt_thread, NULL);
+		free(pt[i].pt_path);
+	}
+	if (rv == 0)
+		rv = pw.pw_rv;
+
+fini:	for (i = 0; i < nthreads; ++i) {
+		free(pw.pw_deques[i].dq_tab);
+		pthread_mutex_destroy(&pw.pw_deques[i].dq_lock);
+	}
+	free(pw.pw_deques);
+	free(pt);
+out:	pthread_mutex_destroy(&pw.pw_lock);
+	pthread_cond_destroy(&pw.pw_workcv);
+	pthread_cond_destroy(&pw.pw_donecv);
+	free(self.pt_path);
+	return rv;
+}
+
+/*
+ * Number of threads of a walk: FSU_WALKTHREADS if set, otherwise one per
+ * CPU of the rump kernel.
+ */
+static int
+fsu_pwalk_nthreads(void)
+{
+	const char *p;
+	long n;
+
+	n = 0;
+	if ((p = getenv("FSU_WALKTHREADS")) != NULL)
+		n = atoi(p);
+	else if ((p = getenv("RUMP_NCPU")) != NULL && strcmp(p, "native"))
+		n = atoi(p);
+	if (n <= 0 && (n = sysconf(_SC_NPROCESSORS_ONLN)) <= 0)
+		n = 1;
+	return n > FSU_PWALK_MAXTHREADS ? FSU_PWALK_MAXTHREADS : (int)n;
+}
+
+static void *
+fsu_pwalk_worker(void *arg)
+{
+	struct fsu_pwthread *pt;
+
+	pt = arg;
+	if (pt->pt_lwp != NULL)
+		rump_pub_lwproc_switch(pt->pt_lwp);
+	fsu_pwalk_loop(pt->pt_pw, pt);
+	if (pt->pt_lwp != NULL)
+		rump_pub_lwproc_releaselwp();
+	return NULL;
+}
+
+/* Reads directories until none is left to read or being read. */
+static void
+fsu_pwalk_loop(struct fsu_pwalk *pw, struct fsu_pwthread *pt)
+{
+	struct fsu_pwdir *d;
+	uint64_t gen;
+	bool skip;
+	int i, n;
+
+	n = pw->pw_nthreads;
+	for (;;) {
+		pthread_mutex_lock(&pw->pw_lock);
+		gen = pw->pw_gen;
+		pthread_mutex_unlock(&pw->pw_lock);
+
+		d = fsu_pwalk_pop(&pw->pw_deques[pt->pt_id]);
+		for (i = 1; d == NULL && i < n; ++i)
+			d = fsu_pwalk_steal(&pw->pw_deques[(pt->pt_id + i) % n]);
+
+		if (d == NULL) {
+			pthread_mutex_lock(&pw->pw_lock);
+			if (pw->pw_active == 0) {
+				pthread_mutex_unlock(&pw->pw_lock);
+				break;
+			}
+			if (pw->pw_gen == gen) {
+				++pw->pw_idle;
+				pthread_cond_wait(&pw->pw_workcv, &pw->pw_lock);
+				--pw->pw_idle;
+			}
+			pthread_mutex_unlock(&pw->pw_lock);
+			continue;
+		}
+
+		pthread_mutex_lock(&pw->pw_lock);
+		skip = d->pd_skip || pw->pw_rv != 0;
+		pthread_mutex_unlock(&pw->pw_lock);
+		if (!skip)
+			fsu_pwalk_read(pw, pt, d);
+
+		pthread_mutex_lock(&pw->pw_lock);
+		if (--pw->pw_active == 0)
+			pthread_cond_broadcast(&pw->pw_workcv);
+		if (pw->pw_flags & FSU_PWALK_ORDERED) {
+			d->pd_done = true;
+			pthread_cond_broadcast(&pw->pw_donecv);
+		}
+		pthread_mutex_unlock(&pw->pw_lock);
+		if (!(pw->pw_flags & FSU_PWALK_ORDERED))
+			fsu_pwalk_freedir(d);
+	}
+}
+
+/*
+ * Reads a directory, calls back for its entries or keeps them, and
+ * pushes its subdirectories on the deque of the thread.
+ */
+static void
+fsu_pwalk_read(struct fsu_pwalk *pw, struct fsu_pwthread *pt,
+    struct fsu_pwdir *d)
+{
+	struct fsu_dirent ents[FSU_PWALK_NBATCH], *de;
+	struct fsu_pwnode *pn;
+	struct fsu_pwdir *sub;
+	struct stat st;
+	FSU_DIR *dir;
+	bool ordered, stated;
+	size_t len, size;
+	void *p;
+	int dfd, error, i, nent, rv, type;
+
+	ordered = (pw->pw_flags & FSU_PWALK_ORDERED) != 0;
+
+	dfd = rump_sys_open(d->pd_path, RUMP_O_RDONLY | RUMP_O_DIRECTORY);
+	if (dfd == -1 || (dir = fsu_fdopendir(dfd, 0)) == NULL) {
+		d->pd_errno = errno;
+		if (dfd != -1)
+			rump_sys_close(dfd);
+		goto dnr;
+	}
+
+	while ((nent = fsu_readdir_batch(dir, ents, FSU_PWALK_NBATCH)) > 0) {
+		for (i = 0; i < nent; ++i) {
+			de = &ents[i];
+			if (de->de_name[0] == '.' && (de->de_namlen == 1 ||
+			    (de->de_namlen == 2 && de->de_name[1] == '.')))
+				continue;
+
+			type = de->de_type;
+			error = 0;
+			stated = false;
+			if (!(pw->pw_flags & FSU_PWALK_NOSTAT) ||
+			    type == DT_UNKNOWN ||
+			    (type == DT_DIR && (pw->pw_flags & FSU_PWALK_XDEV))) {
+				if (rump_sys_fstatat(dfd, de->de_name, &st,
+				    RUMP_AT_SYMLINK_NOFOLLOW) == -1)
+					error = errno;
+				else {
+					stated = true;
+					type = IFTODT(st.st_mode);
+				}
+			}
+
+			sub = NULL;
+			if (type == DT_DIR && error == 0 &&
+			    (!(pw->pw_flags & FSU_PWALK_XDEV) ||
+			     st.st_dev == pw->pw_dev)) {
+				sub = fsu_pwalk_newdir(d->pd_path,
+				    d->pd_pathlen, de->de_name, de->de_namlen,
+				    d->pd_level + 1,
+				    stated ? st.st_dev : d->pd_dev);
+				if (sub == NULL) {
+					fsu_pwalk_stop(pw, -1);
+					break;
+				}
+			}
+
+			if (!ordered) {
+				rv = fsu_pwalk_call(pw, pt, d->pd_path,
+				    d->pd_pathlen, de->de_name, de->de_namlen,
+				    d->pd_level, type, stated ? &st : NULL,
+				    error);
+				if (rv != 0) {
+					fsu_pwalk_freedir(sub);
+					sub = NULL;
+				}
+				if (rv != 0 && rv != FSU_PWALK_SKIP) {
+					fsu_pwalk_stop(pw, rv);
+					break;
+				}
+			} else {
+				if (d->pd_nnodes == d->pd_nodesize) {
+					size = d->pd_nodesize ?
+					    2 * d->pd_nodesize : 16;
+					p = realloc(d->pd_nodes,
+					    size * sizeof(*d->pd_nodes));
+					if (p == NULL)
+						goto nomem;
+					d->pd_nodes = p;
+					d->pd_nodesize = size;
+				}
+				len = (size_t)de->de_namlen + 1;
+				if (d->pd_nameslen + len > d->pd_namesize) {
+					size = d->pd_namesize ?
+					    2 * d->pd_namesize : 1024;
+					while (size < d->pd_nameslen + len)
+						size *= 2;
+					p = realloc(d->pd_names, size);
+					if (p == NULL)
+						goto nomem;
+					d->pd_names = p;
+					d->pd_namesize = size;
+				}
+				pn = &d->pd_nodes[d->pd_nnodes++];
+				pn->pn_name = d->pd_nameslen;
+				memcpy(d->pd_names + d->pd_nameslen,
+				    de->de_name, len);
+				d->pd_nameslen += len;
+				pn->pn_type = type;
+				pn->pn_errno = error;
+				pn->pn_stated = stated;
+				if (stated)
+					pn->pn_st = st;
+				pn->pn_dir = sub;
+			}
+
+			if (sub != NULL && fsu_pwalk_push(pw, pt->pt_id, sub)) {
+				if (ordered)
+					d->pd_nodes[d->pd_nnodes - 1].pn_dir =
+					    NULL;
+				fsu_pwalk_freedir(sub);
+				fsu_pwalk_stop(pw, -1);
+				break;
+			}
+		}
+		if (i < nent || fsu_pwalk_stopped(pw))
+			break;
+	}
+	if (nent == -1)
+		d->pd_errno = errno;
+	fsu_closedir(dir);
+
+dnr:	if (d->pd_errno != 0 && !ordered)
+		fsu_pwalk_call(pw, pt, d->pd_path, d->pd_pathlen, NULL, 0,
+		    d->pd_level - 1, DT_DIR, NULL, d->pd_errno);
+	return;
+
+nomem:	fsu_pwalk_freedir(sub);
+	fsu_closedir(dir);
+	fsu_pwalk_stop(pw, -1);
+}
+
+/* Queues a directory on the deque of a thread. */
+static int
+fsu_pwalk_push(struct fsu_pwalk *pw, int id, struct fsu_pwdir *d)
+{
+	struct fsu_pwdeque *dq;
+	struct fsu_pwdir **tab;
+	size_t i, n, size;
+
+	dq = &pw->pw_deques[id];
+	pthread_mutex_lock(&dq->dq_lock);
+	n = dq->dq_bot - dq->dq_top;
+	if (n == dq->dq_size) {
+		size = dq->dq_size ? 2 * dq->dq_size : FSU_PWALK_DQSIZE;
+		if ((tab = malloc(size * sizeof(*tab))) == NULL) {
+			pthread_mutex_unlock(&dq->dq_lock);
+			return -1;
+		}
+		for (i = 0; i < n; ++i)
+			tab[i] = dq->dq_tab[(dq->dq_top + i) & (dq->dq_size - 1)];
+		free(dq->dq_tab);
+		dq->dq_tab = tab;
+		dq->dq_size = size;
+		dq->dq_top = 0;
+		dq->dq_bot = n;
+	}
+	dq->dq_tab[dq->dq_bot++ & (dq->dq_size - 1)] = d;
+	pthread_mutex_unlock(&dq->dq_lock);
+
+	pthread_mutex_lock(&pw->pw_lock);
+	++pw->pw_active;
+	++pw->pw_gen;
+	if (pw->pw_idle > 0)
+		pthread_cond_signal(&pw->pw_workcv);
+	pthread_mutex_unlock(&pw->pw_lock);
+	return 0;
+}
+
+/* Takes the directory pushed last on the deque of the thread. */
+static struct fsu_pwdir *
+fsu_pwalk_pop(struct fsu_pwdeque *dq)
+{
+	struct fsu_pwdir *d;
+
+	d = NULL;
+	pthread_mutex_lock(&dq->dq_lock);
+	if (dq->dq_bot != dq->dq_top)
+		d = dq->dq_tab[--dq->dq_bot & (dq->dq_size - 1)];
+	pthread_mutex_unlock(&dq->dq_lock);
+	return d;
+}
+
+/* Takes the directory pushed first on the deque of another thread. */
+static struct fsu_pwdir *
+fsu_pwalk_steal(struct fsu_pwdeque *dq)
+{
+	struct fsu_pwdir *d;
+
+	d = NULL;
+	pthread_mutex_lock(&dq->dq_lock);
+	if (dq->dq_bot != dq->dq_top)
+		d = dq->dq_tab[dq->dq_top++ & (dq->dq_size - 1)];
+	pthread_mutex_unlock(&dq->dq_lock);
+	return d;
+}
+
+static struct fsu_pwdir *
+fsu_pwalk_newdir(const char *path, size_t pathlen, const char *name,
+    size_t namelen, int level, dev_t dev)
+{
+	struct fsu_pwdir *d;
+	size_t len;
+
+	if ((d = calloc(1, sizeof(*d))) == NULL)
+		return NULL;
+	/* "/" and "dir/" are joined as fts does, not doubling the slash */
+	if (name != NULL && pathlen > 0 && path[pathlen - 1] == '/')
+		--pathlen;
+	len = name == NULL ? pathlen : pathlen + 1 + namelen;
+	if ((d->pd_path = malloc(len + 1)) == NULL) {
+		free(d);
+		return NULL;
+	}
+	memcpy(d->pd_path, path, pathlen);
+	if (name != NULL) {
+		d->pd_path[pathlen] = '/';
+		memcpy(d->pd_path + pathlen + 1, name, namelen);
+	}
+	d->pd_path[len] = '\0';
+	d->pd_pathlen = len;
+	d->pd_level = level;
+	d->pd_dev = dev;
+	return d;
+}
+
+static void
+fsu_pwalk_freedir(struct fsu_pwdir *d)
+{
+
+	if (d == NULL)
+		return;
+	free(d->pd_path);
+	free(d->pd_nodes);
+	free(d->pd_names);
+	free(d);
+}
+
+/*
+ * Calls back for the entries of d in order, then for those of its
+ * subdirectories, each time it has been read.
+ */
+static int
+fsu_pwalk_deliver(struct fsu_pwalk *pw, struct fsu_pwthread *pt,
+    struct fsu_pwdir *d)
+{
+	struct fsu_pwnode *pn;
+	size_t i;
+	int rv;
+
+	fsu_pwalk_wait(pw, d);
+
+	rv = 0;
+	if (d->pd_errno != 0)
+		rv = fsu_pwalk_call(pw, pt, d->pd_path, d->pd_pathlen, NULL,
+		    0, d->pd_level - 1, DT_DIR, NULL, d->pd_errno);
+	if (rv == FSU_PWALK_SKIP)
+		rv = 0;
+
+	for (i = 0; i < d->pd_nnodes; ++i) {
+		pn = &d->pd_nodes[i];
+		if (rv == 0) {
+			rv = fsu_pwalk_call(pw, pt, d->pd_path,
+			    d->pd_pathlen, d->pd_names + pn->pn_name,
+			    strlen(d->pd_names + pn->pn_name), d->pd_level,
+			    pn->pn_type, pn->pn_stated ? &pn->pn_st : NULL,
+			    pn->pn_errno);
+			if (rv == FSU_PWALK_SKIP) {
+				rv = 0;
+				if (pn->pn_dir != NULL)
+					fsu_pwalk_discard(pw, pn->pn_dir);
+				continue;
+			}
+			if (rv != 0)
+				fsu_pwalk_stop(pw, rv);
+		}
+		if (pn->pn_dir == NULL)
+			continue;
+		if (rv == 0)
+			rv = fsu_pwalk_deliver(pw, pt, pn->pn_dir);
+		else
+			fsu_pwalk_discard(pw, pn->pn_dir);
+	}
+	fsu_pwalk_freedir(d);
+	return rv;
+}
+
+/* Frees d and its subdirectories once read, reading no more of them. */
+static void
+fsu_pwalk_discard(struct fsu_pwalk *pw, struct fsu_pwdir *d)
+{
+	size_t i;
+
+	pthread_mutex_lock(&pw->pw_lock);
+	d->pd_skip = true;
+	pthread_mutex_unlock(&pw->pw_lock);
+	fsu_pwalk_wait(pw, d);
+
+	for (i = 0; i < d->pd_nnodes; ++i)
+		if (d->pd_nodes[i].pn_dir != NULL)
+			fsu_pwalk_discard(pw, d->pd_nodes[i].pn_dir);
+	fsu_pwalk_freedir(d);
+}
+
+/* Waits until d has been read, or dropped. */
+static void
+fsu_pwalk_wait(struct fsu_pwalk *pw, struct fsu_pwdir *d)
+{
+
+	pthread_mutex_lock(&pw->pw_lock);
+	while (!d->pd_done)
+		pthread_cond_wait(&pw->pw_donecv, &pw->pw_lock);
+	pthread_mutex_unlock(&pw->pw_lock);
+}
+
+/*
+ * Calls back for the entry name of the directory path, or for path
+ * itself if name is NULL.
+ */
+static int
+fsu_pwalk_call(struct fsu_pwalk *pw, struct fsu_pwthread *pt,
+    const char *path, size_t pathlen, const char *name, size_t namelen,
+    int level, int type, const struct stat *st, int error)
+{
+	struct fsu_pwent pe;
+	size_t len;
+	char *p;
+
+	if (name != NULL) {
+		if (pathlen > 0 && path[pathlen - 1] == '/')
+			--pathlen;
+		len = pathlen + 1 + namelen;
+		if (len + 1 > pt->pt_pathsize) {
+			if ((p = realloc(pt->pt_path, len + 1)) == NULL)
+				return fsu_pwalk_stop(pw, -1);
+			pt->pt_path = p;
+			pt->pt_pathsize = len + 1;
+		}
+		memcpy(pt->pt_path, path, pathlen);
+		pt->pt_path[pathlen] = '/';
+		memcpy(pt->pt_path + pathlen + 1, name, namelen);
+		pt->pt_path[len] = '\0';
+		pe.pe_path = pt->pt_path;
+		pe.pe_name = pt->pt_path + pathlen + 1;
+	} else {
+		pe.pe_path = path;
+		if ((pe.pe_name = strrchr(path, '/')) != NULL &&
+		    pe.pe_name[1] != '\0')
+			++pe.pe_name;
+		else
+			pe.pe_name = path;
+	}
+	pe.pe_level = level;
+	pe.pe_type = type;
+	pe.pe_st = st;
+	pe.pe_errno = error;
+
+	return pw->pw_cb(&pe, pw->pw_arg);
+}
+
+/* Stops the walk, returning rv from fsu_pwalk if it is the first. */
+static int
+fsu_pwalk_stop(struct fsu_pwalk *pw, int rv)
+{
+
+	pthread_mutex_lock(&pw->pw_lock);
+	if (pw->pw_rv == 0)
+		pw->pw_rv = rv;
+	pthread_mutex_unlock(&pw->pw_lock);
+	return rv;
+}
+
+static bool
+fsu_pwalk_stopped(struct fsu_pwalk *pw)
+{
+	bool stopped;
+
+	pthread_mutex_lock(&pw->pw_lock);
+	stopped = pw->pw_rv != 0;
+	pthread_mutex_unlock(&pw->pw_lock);
+	return stopped;
+}
@@ -0,0 +1,331 @@
+/*
+ * Copyright (c) 2026 The fs-utils authors.  All Rights Reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS
+ * OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include "fs-utils.h"
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <fsu_utils.h>
+
+#include "fsu_stats.h"
+
+/*
+ * Process-wide I/O statistics.  The counters of a handle are added to
+ * the totals when it is closed, and with FSU_STATS set the totals are
+ * printed on stderr at exit, as a table or with FSU_STATS=json as a
+ * JSON object on a single line.
+ */
+
+static void	fsu_stats_add(struct fsu_iostats *, const struct fsu_iostats *);
+static void	fsu_stats_dump(void);
+static void	fsu_stats_phasedump(void);
+
+static pthread_mutex_t fsu_stats_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct fsu_iostats fsu_stats_files, fsu_stats_dirs;
+static uint64_t fsu_stats_nfiles, fsu_stats_ndirs;
+static struct fsu_ftsstats fsu_stats_fts;
+static uint64_t fsu_stats_start;
+
+/*
+ * The phases of mounting and unmounting the image, printed at exit with
+ * FSU_TIMING set, in the same formats.
+ */
+#define FSU_STATS_NPHASES	64
+
+static struct fsu_phase {
+	const char *ph_name;
+	char ph_arg[16];	/* file system type, if any */
+	uint64_t ph_start;	/* since the first phase */
+	uint64_t ph_ns;
+	int ph_rv;
+} fsu_stats_phases[FSU_STATS_NPHASES];
+static int fsu_stats_nphases;
+static uint64_t fsu_stats_phase0;
+
+static const struct {
+	const char *f_name;	/* JSON key */
+	const char *f_desc;	/* table row */
+	size_t f_off;
+} fsu_stats_fields[] = {
+	{ "bytes_read", "bytes read", offsetof(struct fsu_iostats, ios_bread) },
+	{ "bytes_written", "bytes written",
+	  offsetof(struct fsu_iostats, ios_bwritten) },
+	{ "syscalls", "rump syscalls",
+	  offsetof(struct fsu_iostats, ios_syscalls) },
+	{ "rump_ns", "rump time (ns)",
+	  offsetof(struct fsu_iostats, ios_rumpns) },
+	{ "fills", "buffer fills", offsetof(struct fsu_iostats, ios_fills) },
+	{ "flushes", "buffer flushes",
+	  offsetof(struct fsu_iostats, ios_flushes) },
+	{ "seeks", "seeks", offsetof(struct fsu_iostats, ios_seeks) },
+	{ "ra_fills", "read-ahead fills",
+	  offsetof(struct fsu_iostats, ios_rafills) },
+	{ "ra_stalls", "read-ahead stalls",
+	  offsetof(struct fsu_iostats, ios_rastalls) },
+	{ "wb_flushes", "write-behind flushes",
+	  offsetof(struct fsu_iostats, ios_wbflushes) },
+	{ "wb_stalls", "write-behind stalls",
+	  offsetof(struct fsu_iostats, ios_wbstalls) },
+	{ "cache_hits", "cache hits",
+	  offsetof(struct fsu_iostats, ios_cachehits) },
+	{ "cache_misses", "cache misses",
+	  offsetof(struct fsu_iostats, ios_cachemisses) },
+};
+#define FSU_STATS_NFIELDS \
+	(sizeof(fsu_stats_fields) / sizeof(fsu_stats_fields[0]))
+#define FSU_STATS_FIELD(st, i) \
+	(*(const uint64_t *)((const char *)(st) + fsu_stats_fields[i].f_off))
+
+/* Monotonic time in nanoseconds */
+uint64_t
+fsu_stats_clock(void)
+{
+	struct timespec ts;
+
+	if (clock_gettime(CLOCK_MONOTONIC, &ts) == -1)
+		return 0;
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/* Accounts for a rump system call started at time t0 */
+void
+fsu_stats_syscall(struct fsu_iostats *st, uint64_t t0)
+{
+
+	++st->ios_syscalls;
+	st->ios_rumpns += fsu_stats_clock() - t0;
+}
+
+/* Accounts for a request run by the I/O threads */
+void
+fsu_stats_ioreq(struct fsu_iostats *st, const struct fsu_ioreq *req)
+{
+
+	++st->ios_syscalls;
+	st->ios_rumpns += req->ior_ns;
+	if (req->ior_rv <= 0)
+		return;
+	if (req->ior_op == FSU_IO_READ)
+		st->ios_bread += req->ior_rv;
+	else
+		st->ios_bwritten += req->ior_rv;
+}
+
+void
+fsu_stats_fclosed(const struct fsu_iostats *st)
+{
+
+	pthread_mutex_lock(&fsu_stats_lock);
+	++fsu_stats_nfiles;
+	fsu_stats_add(&fsu_stats_files, st);
+	pthread_mutex_unlock(&fsu_stats_lock);
+}
+
+void
+fsu_stats_dclosed(const struct fsu_iostats *st)
+{
+
+	pthread_mutex_lock(&fsu_stats_lock);
+	++fsu_stats_ndirs;
+	fsu_stats_add(&fsu_stats_dirs, st);
+	pthread_mutex_unlock(&fsu_stats_lock);
+}
+
+/*
+ * Accounts for the entries of a walk, the peak of the chunk bytes is
+ * kept rather than their sum.
+ */
+void
+fsu_stats_ftsclosed(const struct fsu_ftsstats *st)
+{
+
+	pthread_mutex_lock(&fsu_stats_lock);
+	fsu_stats_fts.fst_walks += st->fst_walks;
+	fsu_stats_fts.fst_entries += st->fst_entries;
+	fsu_stats_fts.fst_chunks += st->fst_chunks;
+	fsu_stats_fts.fst_reuses += st->fst_reuses;
+	if (st->fst_bytes > fsu_stats_fts.fst_bytes)
+		fsu_stats_fts.fst_bytes = st->fst_bytes;
+	pthread_mutex_unlock(&fsu_stats_lock);
+}
+
+/*
+ * Accounts for a phase of fsu_mount or fsu_unmount started at time t0,
+ * which returned rv.  The first one registers the report, so that it
+ * is printed after the image is unmounted, or if mounting it failed.
+ */
+void
+fsu_stats_phase(const char *name, const char *arg, uint64_t t0, int rv)
+{
+	struct fsu_phase *ph;
+	const char *env;
+
+	if (fsu_stats_nphases == 0) {
+		fsu_stats_phase0 = t0;
+		env = getenv("FSU_TIMING");
+		if (env != NULL && *env != '\0' && strcmp(env, "0") != 0)
+			atexit(fsu_stats_phasedump);
+	}
+	if (fsu_stats_nphases == FSU_STATS_NPHASES)
+		return;
+	ph = &fsu_stats_phases[fsu_stats_nphases++];
+	ph->ph_name = name;
+	strlcpy(ph->ph_arg, arg != NULL ? arg : "", sizeof(ph->ph_arg));
+	ph->ph_start = t0 - fsu_stats_phase0;
+	ph->ph_ns = fsu_stats_clock() - t0;
+	ph->ph_rv = rv;
+}
+
+/*
+ * Called when the image is mounted, the summary is printed after the
+ * handlers registered later, such as the one unmounting the image.
+ */
+void
+fsu_stats_atexit(void)
+{
+	const char *env;
+
+	fsu_stats_start = fsu_stats_clock();
+
+	env = getenv("FSU_STATS");
+	if (env == NULL || *env == '\0' || strcmp(env, "0") == 0)
+		return;
+	atexit(fsu_stats_dump);
+}
+
+void
+fsu_iostats(struct fsu_iostats *files, struct fsu_iostats *dirs)
+{
+
+	pthread_mutex_lock(&fsu_stats_lock);
+	if (files != NULL)
+		*files = fsu_stats_files;
+	if (dirs != NULL)
+		*dirs = fsu_stats_dirs;
+	pthread_mutex_unlock(&fsu_stats_lock);
+}
+
+static void
+fsu_stats_add(struct fsu_iostats *total, const struct fsu_iostats *st)
+{
+	size_t i;
+
+	for (i = 0; i < FSU_STATS_NFIELDS; ++i)
+		*(uint64_t *)((char *)total + fsu_stats_fields[i].f_off) +=
+		    FSU_STATS_FIELD(st, i);
+}
+
+static void
+fsu_stats_dump(void)
+{
+	uint64_t elapsed;
+	size_t i;
+
+	elapsed = fsu_stats_clock() - fsu_stats_start;
+
+	pthread_mutex_lock(&fsu_stats_lock);
+	if (strcmp(getenv("FSU_STATS"), "json") == 0) {
+		fprintf(stderr, "{\"elapsed_ns\":%ju,\"files\":{\"handles\":%ju",
+		    (uintmax_t)elapsed, (uintmax_t)fsu_stats_nfiles);
+		for (i = 0; i < FSU_STATS_NFIELDS; ++i)
+			fprintf(stderr, ",\"%s\":%ju", fsu_stats_fields[i].f_name,
+			    (uintmax_t)FSU_STATS_FIELD(&fsu_stats_files, i));
+		fprintf(stderr, "},\"dirs\":{\"handles\":%ju",
+		    (uintmax_t)fsu_stats_ndirs);
+		for (i = 0; i < FSU_STATS_NFIELDS; ++i)
+			fprintf(stderr, ",\"%s\":%ju", fsu_stats_fields[i].f_name,
+			    (uintmax_t)FSU_STATS_FIELD(&fsu_stats_dirs, i));
+		fprintf(stderr, "},\"fts\":{\"walks\":%ju,\"entries\":%ju,"
+		    "\"chunks\":%ju,\"chunk_reuses\":%ju,\"peak_bytes\":%ju}}\n",
+		    (uintmax_t)fsu_stats_fts.fst_walks,
+		    (uintmax_t)fsu_stats_fts.fst_entries,
+		    (uintmax_t)fsu_stats_fts.fst_chunks,
+		    (uintmax_t)fsu_stats_fts.fst_reuses,
+		    (uintmax_t)fsu_stats_fts.fst_bytes);
+	} else {
+		fprintf(stderr, "%-22s %14s %14s\n", "fsu_stats", "files",
+		    "dirs");
+		fprintf(stderr, "%-22s %14ju %14ju\n", "handles",
+		    (uintmax_t)fsu_stats_nfiles, (uintmax_t)fsu_stats_ndirs);
+		for (i = 0; i < FSU_STATS_NFIELDS; ++i)
+			fprintf(stderr, "%-22s %14ju %14ju\n",
+			    fsu_stats_fields[i].f_desc,
+			    (uintmax_t)FSU_STATS_FIELD(&fsu_stats_files, i),
+			    (uintmax_t)FSU_STATS_FIELD(&fsu_stats_dirs, i));
+		fprintf(stderr, "%-22s %14ju\n", "fts walks",
+		    (uintmax_t)fsu_stats_fts.fst_walks);
+		fprintf(stderr, "%-22s %14ju\n", "fts entries",
+		    (uintmax_t)fsu_stats_fts.fst_entries);
+		fprintf(stderr, "%-22s %14ju\n", "fts chunks",
+		    (uintmax_t)fsu_stats_fts.fst_chunks);
+		fprintf(stderr, "%-22s %14ju\n", "fts chunk reuses",
+		    (uintmax_t)fsu_stats_fts.fst_reuses);
+		fprintf(stderr, "%-22s %14ju\n", "fts peak bytes",
+		    (uintmax_t)fsu_stats_fts.fst_bytes);
+		fprintf(stderr, "%-22s %14ju\n", "elapsed (ns)",
+		    (uintmax_t)elapsed);
+	}
+	pthread_mutex_unlock(&fsu_stats_lock);
+}
+
+static void
+fsu_stats_phasedump(void)
+{
+	const struct fsu_phase *ph;
+	uint64_t total;
+	int i, json;
+
+	json = strcmp(getenv("FSU_TIMING"), "json") == 0;
+	if (json)
+		fprintf(stderr, "{\"phases\":[");
+	else
+		fprintf(stderr, "%-16s %-10s %14s %14s %6s\n", "fsu_timing",
+		    "fs", "start (ns)", "time (ns)", "rv");
+	total = 0;
+	for (i = 0; i < fsu_stats_nphases; i++) {
+		ph = &fsu_stats_phases[i];
+		total += ph->ph_ns;
+		if (json)
+			fprintf(stderr, "%s{\"phase\":\"%s\",\"fs\":\"%s\","
+			    "\"start_ns\":%ju,\"ns\":%ju,\"rv\":%d}",
+			    i == 0 ? "" : ",", ph->ph_name, ph->ph_arg,
+			    (uintmax_t)ph->ph_start, (uintmax_t)ph->ph_ns,
+			    ph->ph_rv);
+		else
+			fprintf(stderr, "%-16s %-10s %14ju %14ju %6d\n",
+			    ph->ph_name, ph->ph_arg, (uintmax_t)ph->ph_start,
+			    (uintmax_t)ph->ph_ns, ph->ph_rv);
+	}
+	if (json)
+		fprintf(stderr, "],\"total_ns\":%ju}\n", (uintmax_t)total);
+	else
+		fprintf(stderr, "%-16s %-10s %14s %14ju\n", "total", "", "",
+		    (uintmax_t)total);
+}
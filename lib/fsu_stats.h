@@ -0,0 +1,53 @@
+/*
+ * Copyright (c) 2026 The fs-utils authors.  All Rights Reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS
+ * OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef _FSU_STATS_H_
+#define _FSU_STATS_H_
+
+#include <stdint.h>
+
+#include <fsu_utils.h>
+
+#include "fsu_io.h"
+
+/* Allocations of the entries of an fsu_fts walk */
+struct fsu_ftsstats {
+	uint64_t fst_walks;	/* FSU_FTS opened */
+	uint64_t fst_entries;	/* entries allocated */
+	uint64_t fst_chunks;	/* chunks malloc'd for them */
+	uint64_t fst_reuses;	/* chunks emptied and reused */
+	uint64_t fst_bytes;	/* bytes of the chunks */
+};
+
+uint64_t	fsu_stats_clock(void);
+void		fsu_stats_syscall(struct fsu_iostats *, uint64_t);
+void		fsu_stats_ioreq(struct fsu_iostats *, const struct fsu_ioreq *);
+void		fsu_stats_fclosed(const struct fsu_iostats *);
+void		fsu_stats_dclosed(const struct fsu_iostats *);
+void		fsu_stats_ftsclosed(const struct fsu_ftsstats *);
+void		fsu_stats_phase(const char *, const char *, uint64_t, int);
+void		fsu_stats_atexit(void);
+
+#endif /* !_FSU_STATS_H_ */
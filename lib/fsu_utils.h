@@ -32,17 +32,61 @@
 #include <stdint.h>
 
 #include <sys/types.h>
+#include <sys/uio.h>
 
 #define user_from_uid(a, b) (NULL)
 #define group_from_gid(a, b) (NULL)
 #define uid_from_user(a, b) (-1)
 
 
+/* I/O statistics of a file or directory handle */
+struct fsu_iostats {
+	uint64_t ios_bread;	/* bytes read */
+	uint64_t ios_bwritten;	/* bytes written */
+	uint64_t ios_syscalls;	/* rump system calls */
+	uint64_t ios_rumpns;	/* nanoseconds spent in them */
+	uint64_t ios_fills;	/* buffer refills */
+	uint64_t ios_flushes;	/* buffers written back */
+	uint64_t ios_seeks;	/* repositionings */
+	uint64_t ios_rafills;	/* refills served by the read-ahead */
+	uint64_t ios_rastalls;	/* ... which had to wait for the I/O */
+	uint64_t ios_wbflushes;	/* buffers written back in the background */
+	uint64_t ios_wbstalls;	/* ... which had to wait for a free buffer */
+	uint64_t ios_cachehits;	/* refills served by the cached blocks */
+	uint64_t ios_cachemisses; /* ... and read from the file */
+};
+
 /* File Descriptor */
 
+struct fsu_fcache;
+struct fsu_fring;
+
+/*
+ * Bounds for the buffer of a FSU_FILE.  FSU_BUFSIZ is also the smallest
+ * buffer the default policy will pick, FSU_BUFSIZ_DEFMAX the largest.
+ * Larger buffers can still be requested with fsu_setvbuf().
+ */
+#define FSU_BUFSIZ              (8192)
+#define FSU_BUFSIZ_DEFMAX       (1024 * 1024)
+#define FSU_BUFSIZ_MAX          (64 * 1024 * 1024)
+
+/* Read-ahead depth of streams opened for reading only, and its bound */
+#define FSU_RADEPTH             (2)
+#define FSU_RADEPTH_MAX         (16)
+
+/* Write-behind depth of streams opened for writing only, and its bound */
+#define FSU_WBDEPTH             (2)
+#define FSU_WBDEPTH_MAX         (16)
+
+/* Bound of the number of blocks cached by a stream */
+#define FSU_FCACHE_MAX          (1024)
+
 typedef struct {
 	int fd_fd;
-        uint8_t fd_buf[8192];   /* current buffer */
+        uint8_t *fd_buf;        /* current buffer */
+        size_t fd_bufsize;      /* size of the buffer */
+        size_t fd_blksize;      /* preferred I/O size of the file */
+        bool fd_freebuf;        /* fd_buf has been allocated by fsu_fopen */
         size_t fd_bpos;         /* position in the buffer */
         size_t fd_fpos;         /* position in the file */
         size_t fd_last;         /* last position in the file buffered */
@@ -52,25 +96,48 @@ typedef struct {
 #define FSU_FILE_READ           (1)
 #define FSU_FILE_WRITE          (2)
 #define FSU_FILE_READWRITE      (3)
+#define FSU_FILE_APPEND         (4)
         uint8_t fd_mode;        /* access mode */
 
         bool fd_dirty;          /* has the buffer been modified */
+
+        char *fd_lbuf;          /* lines read across refills */
+        size_t fd_lbufsize;     /* size of fd_lbuf */
+
+        struct fsu_fring *fd_ra;  /* read-ahead state, NULL if disabled */
+        struct fsu_fring *fd_wb;  /* write-behind state, NULL if disabled */
+        struct fsu_fcache *fd_cache; /* cached blocks, NULL if disabled */
+
+        struct fsu_iostats fd_stats; /* I/O statistics */
 } FSU_FILE;
 
 /* Directory descriptor */
 typedef struct {
 	int dd_fd;
-        uint8_t dd_buf[8192];   /* current buffer */
+        uint8_t *dd_buf;        /* current buffer */
+        size_t dd_bufsize;      /* size of dd_buf */
         off_t dd_off;           /* position in the directory */
         int dd_size;            /* size returned by last getdents */
         struct dirent *dd_dent; /* current dir entry */
+        struct fsu_iostats dd_stats; /* I/O statistics */
 } FSU_DIR;
 
+/* Directory entry filled by fsu_readdir_batch */
+struct fsu_dirent {
+	ino_t de_ino;
+	const char *de_name;	/* in the buffer of the FSU_DIR */
+	uint16_t de_namlen;
+	uint8_t de_type;	/* DT_*, DT_UNKNOWN if not known */
+};
+
 /* Files */
 FSU_FILE        *fsu_fopen(const char *, const char *);
 char            fsu_fgetc(FSU_FILE *);
 int             fsu_fputc(int, FSU_FILE *);
-void            fsu_fclose(FSU_FILE *);
+char            *fsu_fgetln(FSU_FILE *, size_t *);
+ssize_t         fsu_getdelim(char **, size_t *, int, FSU_FILE *);
+ssize_t         fsu_getline(char **, size_t *, FSU_FILE *);
+int             fsu_fclose(FSU_FILE *);
 void            fsu_rewind(FSU_FILE *);
 bool            fsu_feof(FSU_FILE *);
 void            fsu_clearerr(FSU_FILE *);
@@ -80,14 +147,72 @@ size_t          fsu_fwrite(void *, size_t, size_t, FSU_FILE *);
 int		fsu_fflush(FSU_FILE *);
 int		fsu_fseek(FSU_FILE *, long, int);
 int		fsu_fseeko(FSU_FILE *, off_t, int);
+ssize_t		fsu_pread(FSU_FILE *, void *, size_t, off_t);
+ssize_t		fsu_pwrite(FSU_FILE *, const void *, size_t, off_t);
+ssize_t		fsu_preadv(FSU_FILE *, const struct iovec *, int, off_t);
+ssize_t		fsu_pwritev(FSU_FILE *, const struct iovec *, int, off_t);
 long int	fsu_ftell(FSU_FILE *);
 off_t		fsu_ftello(FSU_FILE *);
+int		fsu_setvbuf(FSU_FILE *, char *, int, size_t);
+int		fsu_freadahead(FSU_FILE *, int);
+int		fsu_fwritebehind(FSU_FILE *, int);
+int		fsu_fcache(FSU_FILE *, int);
+void		fsu_fstats(FSU_FILE *, struct fsu_iostats *);
+
+/* Asynchronous I/O on rump file descriptors */
+typedef struct fsu_aioq FSU_AIOQ;
+
+struct fsu_aioev {
+	void *ev_cookie;	/* as given when submitted */
+	void *ev_buf;		/* buffer of the request */
+	off_t ev_off;		/* offset of the request */
+	ssize_t ev_rv;		/* bytes transferred or -1 */
+	int ev_errno;		/* errno if ev_rv is -1 */
+};
+
+FSU_AIOQ	*fsu_aioq_create(void);
+void		fsu_aioq_destroy(FSU_AIOQ *);
+int		fsu_aioq_pending(FSU_AIOQ *);
+int		fsu_aioq_wait(FSU_AIOQ *, struct fsu_aioev *, int, int);
+int		fsu_aread(FSU_AIOQ *, int, void *, size_t, off_t, void *);
+int		fsu_awrite(FSU_AIOQ *, int, const void *, size_t, off_t, void *);
+
+/* Copy between rump file descriptors */
+off_t		fsu_copy_range(int, off_t, int, off_t, off_t);
+
+/* Parallel walk of a file hierarchy */
+#define FSU_PWALK_NOSTAT	0x01	/* stat only entries of unknown type */
+#define FSU_PWALK_ORDERED	0x02	/* call back in pre-order, serially */
+#define FSU_PWALK_XDEV		0x04	/* don't cross devices */
+#define FSU_PWALK_MASK		0x07
+
+#define FSU_PWALK_SKIP		1	/* from the callback: don't descend */
+
+struct fsu_pwent {
+	const char *pe_path;		/* root, then each component */
+	const char *pe_name;		/* last component */
+	int pe_level;			/* 0 for the root */
+	int pe_type;			/* DT_* */
+	const struct stat *pe_st;	/* NULL if not stat'ed */
+	int pe_errno;			/* stat or read error, 0 if none */
+};
+
+typedef int (*fsu_pwalk_cb)(const struct fsu_pwent *, void *);
+
+int		fsu_pwalk(const char *, int, int, fsu_pwalk_cb, void *);
 
 /* Directory */
 FSU_DIR         *fsu_opendir(const char *);
+FSU_DIR         *fsu_opendir_hint(const char *, size_t);
+FSU_DIR         *fsu_fdopendir(int, size_t);
 struct dirent   *fsu_readdir(FSU_DIR *);
+int             fsu_readdir_batch(FSU_DIR *, struct fsu_dirent *, int);
 void            fsu_closedir(FSU_DIR *);
 void            fsu_rewinddir(FSU_DIR *);
+void            fsu_dirstats(FSU_DIR *, struct fsu_iostats *);
+void            fsu_iostats(struct fsu_iostats *, struct fsu_iostats *);
+int             fsu_chdir(const char *);
+int             fsu_fchdir(int);
 char            *fsu_getcwd(void);
 char		*fsu_getapath(const char *);
 
@@ -38,5 +38,6 @@
 #define fts_open(a, b, c) fsu_fts_open(a, b, c)
 #define fts_read(a) fsu_fts_read(a)
 #define fts_set(a, b, c) fsu_fts_set(a, b, c)
+#define fts_setsort(a, b) fsu_fts_setsort(a, b)
 
 #endif /* !FSU_FTS2FSUFTS_H_ */
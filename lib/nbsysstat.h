@@ -11,3 +11,43 @@
 #define	SF_SNAPSHOT	0x00200000	/* snapshot inode */
 #define	SF_LOG		0x00400000	/* WAPBL log file inode */
 #endif
+
+/* from sys/statvfs.h */
+#ifndef NB_VFS_NAMELEN
+#define	NB_VFS_NAMELEN	32
+#define	NB_VFS_MNAMELEN	1024
+struct nbstatvfs {
+	unsigned long	f_flag;
+	unsigned long	f_bsize;
+	unsigned long	f_frsize;
+	unsigned long	f_iosize;
+
+	uint64_t	f_blocks;
+
+	uint64_t	f_bfree;
+	uint64_t	f_bavail;
+	uint64_t	f_bresvd;
+
+	uint64_t	f_files;
+	uint64_t	f_ffree;
+	uint64_t	f_favail;
+	uint64_t	f_fresvd;
+
+	uint64_t  	f_syncreads;
+	uint64_t  	f_syncwrites;
+
+	uint64_t  	f_asyncreads;
+	uint64_t  	f_asyncwrites;
+
+	uint32_t	f_notused[2];
+	unsigned long	f_fsid;
+	unsigned long	f_namemax;
+	uint32_t	f_owner;
+
+	uint32_t	f_spare[4];
+
+	char	f_fstypename[NB_VFS_NAMELEN];
+	char	f_mntonname[NB_VFS_MNAMELEN];
+	char	f_mntfromname[NB_VFS_MNAMELEN];
+};
+#endif
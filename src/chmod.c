@@ -70,6 +70,8 @@ __RCSID("$NetBSD: chmod.c,v 1.3 2009/11/06 11:47:40 stacktic Exp $");
 #include <fsu_utils.h>
 #include <fsu_mount.h>
 
+#include "fsu_batch.h"
+
 #ifdef HAVE_LCHMOD
 #define WRAP_LCHMOD __wrap_lchmod
 #else
@@ -93,19 +95,14 @@ WRAP_LCHMOD(const char *path, mode_t mode)
 	return rump_sys_lchmod(path, mode);
 }
 
+static void	usage(void);
 
+#ifndef FSU_BATCH
 int	main(int, char *[]);
-void	usage(void);
 
 int
 main(int argc, char *argv[])
 {
-	FTS *ftsp;
-	FTSENT *p;
-	mode_t *set;
-	int Hflag, Lflag, Rflag, ch, fflag, fts_options, hflag, rval;
-	char *mode;
-	int (*change_mode)(const char *, mode_t);
 
 	setprogname(argv[0]);
 	(void)setlocale(LC_ALL, "");
@@ -113,6 +110,21 @@ main(int argc, char *argv[])
 	if (fsu_mount(&argc, &argv, MOUNT_READWRITE) != 0)
 		usage();
 
+	exit(chmod_main(argc, argv));
+	/* NOTREACHED */
+}
+#endif
+
+int
+chmod_main(int argc, char *argv[])
+{
+	FTS *ftsp;
+	FTSENT *p;
+	mode_t *set;
+	int Hflag, Lflag, Rflag, ch, fflag, fts_options, hflag, rval;
+	char *mode;
+	int (*change_mode)(const char *, mode_t);
+
 	Hflag = Lflag = Rflag = fflag = hflag = 0;
 	while ((ch = getopt(argc, argv, "HLPRXfghorstuwx")) != -1)
 		switch (ch) {
@@ -238,11 +250,12 @@ done:	argv += optind;
 		err(EXIT_FAILURE, "fts_read");
 		/* NOTREACHED */
 	}
-	exit(rval);
-	/* NOTREACHED */
+	(void)fts_close(ftsp);
+	free(set);
+	return rval;
 }
 
-void
+static void
 usage(void)
 {
 
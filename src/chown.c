@@ -71,6 +71,8 @@ __RCSID("$NetBSD: chown.c,v 1.2 2009/11/06 11:47:42 stacktic Exp $");
 #include <fsu_utils.h>
 #include <fsu_mount.h>
 
+#include "fsu_batch.h"
+
 
 
 int __wrap_chown(const char *, uid_t, gid_t);
@@ -101,14 +103,13 @@ static gid_t gid;
 static int ischown;
 static char *myname;
 
+#ifndef FSU_BATCH
+int	main(int, char **);
+
 int
 main(int argc, char **argv)
 {
-	FTS *ftsp;
-	FTSENT *p;
-	int Hflag, Lflag, Rflag, ch, fflag, fts_options, hflag, rval, vflag;
 	char *cp;
-	int (*change_owner)(const char *, uid_t, gid_t);
 
 	(void)setlocale(LC_ALL, "");
 
@@ -118,6 +119,25 @@ main(int argc, char **argv)
 	if (fsu_mount(&argc, &argv, MOUNT_READWRITE) != 0)
 		usage();
 
+	exit(chown_main(argc, argv));
+	/* NOTREACHED */
+}
+#endif
+
+int
+chown_main(int argc, char **argv)
+{
+	FTS *ftsp;
+	FTSENT *p;
+	int Hflag, Lflag, Rflag, ch, fflag, fts_options, hflag, rval, vflag;
+	char *cp;
+	int (*change_owner)(const char *, uid_t, gid_t);
+
+#ifdef FSU_BATCH
+	myname = (cp = strrchr(*argv, '/')) ? cp + 1 : *argv;
+	ischown = (myname[6] == 'o' || myname[2] == 'o');
+#endif
+
 	Hflag = Lflag = Rflag = fflag = hflag = vflag = 0;
 	while ((ch = getopt(argc, argv, "HLPRfhv")) != -1)
 		switch (ch) {
@@ -251,8 +271,8 @@ main(int argc, char **argv)
 	}
 	if (errno)
 		err(EXIT_FAILURE, "fts_read");
-	exit(rval);
-	/* NOTREACHED */
+	(void)fts_close(ftsp);
+	return rval;
 }
 
 static void
@@ -81,10 +81,37 @@ __RCSID("$NetBSD: du.c,v 1.3 2010/08/23 17:09:59 stacktic Exp $");
 #include "fsu_compat.h"
 #endif
 
+/* A directory being walked by fsu_pwalk, its total is printed after it */
+struct dudir {
+	char	*path;
+	int	level;
+	int64_t	blocks;		/* its own, then those of its entries */
+	int	dnr;		/* could not be read, not counted */
+};
+
+/* State of the physical walks, the callbacks are made in pre-order */
+struct duwalk {
+	struct dudir *dirs;	/* from the root down to the current one */
+	int	ndirs;
+	int	dirsize;
+	int	depth;
+	int	listfiles;
+	int	cflag;
+	int	nflag;
+	int64_t	totalblocks;
+	int	rval;
+};
+
 int	linkchk(dev_t, ino_t);
 void	prstat(const char *, int64_t);
 void	usage(void);
 
+static void	du_pwalk(const char *, int, struct duwalk *);
+static int	du_entry(const struct fsu_pwent *, void *);
+static void	du_leave(struct duwalk *, int);
+static void	du_file(struct duwalk *, const char *, int,
+		    const struct stat *);
+
 int hflag;
 long blocksize;
 
@@ -93,6 +120,7 @@ main(int argc, char *argv[])
 {
 	FTS *fts;
 	FTSENT *p;
+	struct duwalk dw;
 	int64_t totalblocks;
 	int ftsoptions, listfiles;
 	int depth;
@@ -106,7 +134,7 @@ main(int argc, char *argv[])
 
 	Hflag = Lflag = aflag = cflag = dflag = gkmflag = nflag = sflag = 0;
 	totalblocks = 0;
-	ftsoptions = FTS_PHYSICAL;
+	ftsoptions = FTS_PHYSICAL | FTS_DIRFD | FTS_INOSORT;
 	depth = INT_MAX;
 	while ((ch = getopt(argc, argv, "HLPacd:ghkmnrsx")) != -1)
 		switch (ch) {
@@ -209,6 +237,22 @@ main(int argc, char *argv[])
 		(void)getbsize(NULL, &blocksize);
 	blocksize /= 512;
 
+	/* Physical walks are done by several threads. */
+	if (!Hflag && !Lflag) {
+		memset(&dw, 0, sizeof(dw));
+		dw.depth = depth;
+		dw.listfiles = listfiles;
+		dw.cflag = cflag;
+		dw.nflag = nflag;
+		for (; *argv != NULL; argv++)
+			du_pwalk(*argv, ftsoptions & FTS_XDEV ?
+			    FSU_PWALK_XDEV : 0, &dw);
+		free(dw.dirs);
+		if (cflag)
+			prstat("total", dw.totalblocks);
+		exit(dw.rval);
+	}
+
 	if ((fts = fts_open(argv, ftsoptions, NULL)) == NULL)
 		err(1, "fts_open `%s'", *argv);
 
@@ -275,6 +319,122 @@ main(int argc, char *argv[])
 	exit(rval);
 }
 
+/*
+ * Walks the hierarchy under root as the fts loop of main does without
+ * -H or -L, which is what the order of the callbacks of fsu_pwalk with
+ * FSU_PWALK_ORDERED allows: a directory is done when an entry which is
+ * not under it comes.
+ */
+static void
+du_pwalk(const char *root, int flags, struct duwalk *dw)
+{
+	struct stat sb;
+
+	/* A symbolic link given is not followed, unlike by fsu_pwalk. */
+	if (rump_sys_lstat(root, &sb) == -1) {
+		warn("%s", root);
+		dw->rval = 1;
+		return;
+	}
+	if (!S_ISDIR(sb.st_mode)) {
+		du_file(dw, root, 0, &sb);
+		return;
+	}
+
+	if (fsu_pwalk(root, flags | FSU_PWALK_ORDERED, 0, du_entry, dw) != 0)
+		err(1, "fsu_pwalk `%s'", root);
+	du_leave(dw, 0);
+}
+
+static int
+du_entry(const struct fsu_pwent *pe, void *arg)
+{
+	struct duwalk *dw;
+	struct dudir *d;
+	void *p;
+	int size;
+
+	dw = arg;
+
+	/* A directory which cannot be read comes again, right after. */
+	if (pe->pe_errno != 0 && pe->pe_type == DT_DIR && dw->ndirs > 0 &&
+	    (d = &dw->dirs[dw->ndirs - 1])->level == pe->pe_level &&
+	    strcmp(d->path, pe->pe_path) == 0) {
+		warnx("%s: %s", pe->pe_path, strerror(pe->pe_errno));
+		dw->rval = 1;
+		d->dnr = 1;
+		return 0;
+	}
+
+	du_leave(dw, pe->pe_level);
+
+	if (pe->pe_errno != 0) {
+		warnx("%s: %s", pe->pe_path, strerror(pe->pe_errno));
+		dw->rval = 1;
+		return 0;
+	}
+#ifdef HAVE_STRUCT_STAT_ST_FLAGS
+	if (dw->nflag && (pe->pe_st->st_flags & UF_NODUMP))
+		return FSU_PWALK_SKIP;
+#endif
+
+	if (pe->pe_type != DT_DIR) {
+		du_file(dw, pe->pe_path, pe->pe_level, pe->pe_st);
+		return 0;
+	}
+
+	if (dw->ndirs == dw->dirsize) {
+		size = dw->dirsize ? 2 * dw->dirsize : 32;
+		if ((p = realloc(dw->dirs, size * sizeof(*dw->dirs))) == NULL)
+			err(1, "realloc");
+		dw->dirs = p;
+		dw->dirsize = size;
+	}
+	d = &dw->dirs[dw->ndirs++];
+	if ((d->path = strdup(pe->pe_path)) == NULL)
+		err(1, "strdup");
+	d->level = pe->pe_level;
+	d->blocks = pe->pe_st->st_blocks;
+	d->dnr = 0;
+	if (dw->cflag)
+		dw->totalblocks += pe->pe_st->st_blocks;
+	return 0;
+}
+
+/* Done with the directories at level and below: the FTS_DP of main. */
+static void
+du_leave(struct duwalk *dw, int level)
+{
+	struct dudir *d;
+
+	while (dw->ndirs > 0 && (d = &dw->dirs[dw->ndirs - 1])->level >= level) {
+		dw->ndirs--;
+		if (!d->dnr) {
+			if (dw->ndirs > 0)
+				dw->dirs[dw->ndirs - 1].blocks += d->blocks;
+			if (d->level <= dw->depth ||
+			    (!dw->listfiles && !d->level))
+				prstat(d->path, d->blocks);
+		}
+		free(d->path);
+	}
+}
+
+/* Any file but a directory: the default case of main. */
+static void
+du_file(struct duwalk *dw, const char *path, int level, const struct stat *sb)
+{
+
+	if (sb->st_nlink > 1 && linkchk(sb->st_dev, sb->st_ino))
+		return;
+	if (dw->listfiles || !level)
+		prstat(path, sb->st_blocks);
+	if (dw->ndirs > 0)
+		dw->dirs[dw->ndirs - 1].blocks += sb->st_blocks;
+	if (dw->cflag)
+		dw->totalblocks += sb->st_blocks;
+}
+
 void
 prstat(const char *fname, int64_t blocks)
 {
@@ -53,6 +53,7 @@ int	 ls_main(int, char *[]);
 int	 printescaped(const char *);
 void	 printacol(DISPLAY *);
 void	 printcol(DISPLAY *);
+void	 printentry(DISPLAY *, FTSENT *);
 void	 printlong(DISPLAY *);
 void	 printscol(DISPLAY *);
 void	 printstream(DISPLAY *);
@@ -0,0 +1,318 @@
+/*
+ * Copyright (c) 2026 The fs-utils authors.  All Rights Reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS
+ * OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+#include "fs-utils.h"
+
+#include <sys/stat.h>
+
+#include <errno.h>
+#include <locale.h>
+#include <setjmp.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <rump/rumpdefs.h>
+#include <rump/rump_syscalls.h>
+
+#include <fsu_utils.h>
+#include <fsu_mount.h>
+#include <fsu_stats.h>
+
+#include "fsu_batch.h"
+
+/*
+ * Runs the commands of a script against an image mounted once.  The
+ * programs are linked in and called through their *_main entry points,
+ * exit, err and errx being wrapped so that a command which exits only
+ * ends itself.  A command ended that way may leave behind the memory and
+ * the descriptors it had opened, but not a different current directory.
+ */
+static const struct batch_cmd {
+	const char *bc_name;
+	int (*bc_main)(int, char *[]);
+	int bc_prompts;			/* -i reads answers from stdin */
+} batch_cmds[] = {
+	{ "chgrp",	chown_main,	0 },
+	{ "chmod",	chmod_main,	0 },
+	{ "chown",	chown_main,	0 },
+	{ "ecp",	ecp_main,	0 },
+	{ "get",	ecp_main,	0 },
+	{ "ln",		ln_main,	1 },
+	{ "mkdir",	mkdir_main,	0 },
+	{ "put",	ecp_main,	0 },
+	{ "rm",		rm_main,	1 },
+	{ "rmdir",	rmdir_main,	0 },
+};
+
+static const struct batch_cmd *lookup(const char *);
+static int	prompts(const struct batch_cmd *, int, char *[]);
+static int	run(const struct batch_cmd *, int, char *[]);
+static void	usage(void);
+
+void	__real_exit(int) __dead;
+void	__wrap_exit(int) __dead;
+void	__wrap_err(int, const char *, ...) __dead;
+void	__wrap_errx(int, const char *, ...) __dead;
+
+static jmp_buf cmd_env;
+static int cmd_running, cmd_status;
+
+int
+main(int argc, char *argv[])
+{
+	const struct batch_cmd *bc;
+	const char *progname;
+	FILE *fp;
+	const char *script;
+	char *line, *p, **cargv;
+	size_t linesize;
+	uint64_t t0;
+	mode_t mask, rmask;
+	int cargc, ch, eflag, lineno, nfailed, nrun, status, vflag;
+
+	setprogname(argv[0]);
+	progname = getprogname();
+	(void)setlocale(LC_ALL, "");
+
+	if (fsu_mount(&argc, &argv, MOUNT_READWRITE) != 0)
+		usage();
+
+	eflag = vflag = 0;
+	while ((ch = getopt(argc, argv, "ev")) != -1) {
+		switch (ch) {
+		case 'e':
+			eflag = 1;
+			break;
+		case 'v':
+			vflag = 1;
+			break;
+		case '?':
+		default:
+			usage();
+			/* NOTREACHED */
+		}
+	}
+	argc -= optind;
+	argv += optind;
+
+	if (argc > 1)
+		usage();
+	if (argc == 0 || strcmp(argv[0], "-") == 0) {
+		script = "stdin";
+		fp = stdin;
+	} else {
+		script = argv[0];
+		if ((fp = fopen(script, "r")) == NULL)
+			err(EXIT_FAILURE, "%s", script);
+	}
+
+	/* Restored for each command, ecp and mkdir change them. */
+	mask = umask(0);
+	rmask = rump_sys_umask(0);
+
+	line = NULL;
+	linesize = 0;
+	nfailed = nrun = 0;
+	for (lineno = 1; getline(&line, &linesize, fp) != -1; lineno++) {
+		p = line + strspn(line, " \t");
+		p[strcspn(p, "\n")] = '\0';
+		if (*p == '\0' || *p == '#')
+			continue;
+
+		/* No more arguments than half the characters of the line. */
+		cargv = malloc((strlen(p) / 2 + 3) * sizeof(*cargv));
+		if (cargv == NULL)
+			err(EXIT_FAILURE, NULL);
+		fsu_str2arg(p, &cargc, cargv, strlen(p) / 2 + 2);
+		if (cargc == 0) {
+			/* no command, cargv[0] is not set */
+			free(cargv);
+			continue;
+		}
+		if (strncmp(cargv[0], "fsu_", 4) == 0)
+			cargv[0] += 4;
+
+		if ((bc = lookup(cargv[0])) == NULL) {
+			warnx("%s:%d: %s: unknown command", script, lineno,
+			    cargv[0]);
+			status = EXIT_FAILURE;
+		} else if (fp == stdin && prompts(bc, cargc, cargv)) {
+			warnx("%s:%d: %s: -i would read the script",
+			    script, lineno, bc->bc_name);
+			status = EXIT_FAILURE;
+		} else {
+			(void)umask(mask);
+			(void)rump_sys_umask(rmask);
+			t0 = fsu_stats_clock();
+			status = run(bc, cargc, cargv);
+			setprogname(progname);
+			if (vflag)
+				printf("%s:%d: %s: status %d, %.3f ms\n",
+				    script, lineno, bc->bc_name, status,
+				    (fsu_stats_clock() - t0) / 1e6);
+			else if (status != 0)
+				warnx("%s:%d: %s: status %d", script, lineno,
+				    bc->bc_name, status);
+		}
+		free(cargv);
+		++nrun;
+		if (status != 0) {
+			++nfailed;
+			if (eflag)
+				break;
+		}
+	}
+	if (ferror(fp))
+		err(EXIT_FAILURE, "%s", script);
+	free(line);
+	if (fp != stdin)
+		fclose(fp);
+
+	if (vflag)
+		printf("%d commands, %d failed\n", nrun, nfailed);
+	return nfailed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+static const struct batch_cmd *
+lookup(const char *name)
+{
+	size_t i;
+
+	for (i = 0; i < sizeof(batch_cmds) / sizeof(batch_cmds[0]); i++)
+		if (strcmp(name, batch_cmds[i].bc_name) == 0)
+			return &batch_cmds[i];
+	return NULL;
+}
+
+/*
+ * Tells whether a command is given -i, its options take no argument.
+ * getopt may take options after the operands.
+ */
+static int
+prompts(const struct batch_cmd *bc, int argc, char *argv[])
+{
+	int i;
+
+	if (!bc->bc_prompts)
+		return 0;
+	for (i = 1; i < argc && strcmp(argv[i], "--") != 0; i++)
+		if (argv[i][0] == '-' && strchr(argv[i], 'i') != NULL)
+			return 1;
+	return 0;
+}
+
+/*
+ * Calls the entry point of a command as its main function would, and
+ * returns its exit status, whether it returned or exited.  The current
+ * directory is restored either way.
+ */
+static int
+run(const struct batch_cmd *bc, int argc, char *argv[])
+{
+	int dotfd, status;
+
+	if ((dotfd = rump_sys_open(".", RUMP_O_RDONLY)) == -1) {
+		warn("%s: .", bc->bc_name);
+		return EXIT_FAILURE;
+	}
+
+	setprogname(bc->bc_name);
+#ifdef HAVE_GETOPT_OPTRESET
+	optind = 1;
+	optreset = 1;
+#else
+	optind = 0;		/* glibc and musl start over from 0 only */
+#endif
+	if (setjmp(cmd_env) == 0) {
+		cmd_running = 1;
+		status = bc->bc_main(argc, argv);
+	} else
+		status = cmd_status;
+	cmd_running = 0;
+	fflush(stdout);
+
+	if (fsu_fchdir(dotfd) == -1)
+		err(EXIT_FAILURE, "%s: cannot restore the current directory",
+		    bc->bc_name);
+	rump_sys_close(dotfd);
+	return status;
+}
+
+void
+__wrap_exit(int status)
+{
+
+	if (cmd_running) {
+		cmd_status = status;
+		longjmp(cmd_env, 1);
+	}
+	__real_exit(status);
+}
+
+void
+__wrap_err(int eval, const char *fmt, ...)
+{
+	char msg[BUFSIZ];
+	va_list ap;
+
+	if (fmt == NULL)
+		warn(NULL);
+	else {
+		va_start(ap, fmt);
+		(void)vsnprintf(msg, sizeof(msg), fmt, ap);
+		va_end(ap);
+		warn("%s", msg);
+	}
+	__wrap_exit(eval);
+}
+
+void
+__wrap_errx(int eval, const char *fmt, ...)
+{
+	char msg[BUFSIZ];
+	va_list ap;
+
+	if (fmt == NULL)
+		warnx(NULL);
+	else {
+		va_start(ap, fmt);
+		(void)vsnprintf(msg, sizeof(msg), fmt, ap);
+		va_end(ap);
+		warnx("%s", msg);
+	}
+	__wrap_exit(eval);
+}
+
+static void
+usage(void)
+{
+
+	fprintf(stderr, "usage: %s %s [-ev] [script]\n",
+		getprogname(), fsu_mount_usage());
+
+	exit(EXIT_FAILURE);
+}
@@ -55,6 +55,18 @@
 #define FSU_CAT_NON_PRINTING (FSU_CAT_TAB<<1)
 #define BUFSIZE (8192)
 
+/* reads of regular files kept in flight, and their size */
+#define FSU_CAT_NAIO (4)
+#define FSU_CAT_AIOSIZE (64 * 1024)
+
+struct fsu_cat_aio {
+	uint8_t *ca_buf;
+	ssize_t ca_rv;		/* bytes read or -1 */
+	int ca_errno;
+	bool ca_done;		/* has the read completed */
+};
+
+static int	fsu_aio_cat(const char *, int, int);
 static int	fsu_cat(const char *, int);
 static int	fsu_cat_parse_arg(int *, char ***);
 static void	fsu_cook_buf(const char *, int);
@@ -289,6 +301,10 @@ fsu_raw_cat(const char *filename)
 		fd = STDIN_FILENO;
 
 	wfd = fileno(stdout);
+	if (!from_stdin && rump_sys_fstat(fd, &sbuf) == 0 &&
+	    S_ISREG(sbuf.st_mode))
+		return fsu_aio_cat(filename, fd, wfd);
+
 	bsize = 0;
 	buf = NULL;
 	if (fstat(wfd, &sbuf) == 0 && sbuf.st_blksize > sizeof(fb_buf)) {
@@ -331,6 +347,80 @@ out:
 	return rv;
 }
 
+/*
+ * Copies a regular file to wfd keeping several reads in flight, they
+ * are written in order.
+ */
+static int
+fsu_aio_cat(const char *filename, int fd, int wfd)
+{
+	struct fsu_cat_aio aio[FSU_CAT_NAIO], *a, *done;
+	struct fsu_aioev ev;
+	FSU_AIOQ *q;
+	uint8_t *bufs;
+	ssize_t nr, nw, off;
+	off_t roff;
+	int i, rv;
+
+	bufs = malloc(FSU_CAT_NAIO * FSU_CAT_AIOSIZE);
+	if (bufs == NULL || (q = fsu_aioq_create()) == NULL) {
+		warn(NULL);
+		free(bufs);
+		return -1;
+	}
+
+	rv = 0;
+	roff = 0;
+	for (i = 0; i < FSU_CAT_NAIO; ++i) {
+		a = &aio[i];
+		a->ca_buf = bufs + i * FSU_CAT_AIOSIZE;
+		a->ca_done = false;
+		if (fsu_aread(q, fd, a->ca_buf, FSU_CAT_AIOSIZE, roff, a) == -1)
+			goto fail;
+		roff += FSU_CAT_AIOSIZE;
+	}
+
+	for (i = 0;; i = (i + 1) % FSU_CAT_NAIO) {
+		a = &aio[i];
+		while (!a->ca_done) {
+			fsu_aioq_wait(q, &ev, 1, 1);
+			done = ev.ev_cookie;
+			done->ca_rv = ev.ev_rv;
+			done->ca_errno = ev.ev_errno;
+			done->ca_done = true;
+		}
+		if ((nr = a->ca_rv) == -1) {
+			errno = a->ca_errno;
+			goto fail;
+		}
+
+		for (off = 0; nr; nr -= nw, off += nw)
+			if ((nw = write(wfd, a->ca_buf + off, (size_t)nr)) < 0) {
+				warn("stdout");
+				rv = -1;
+				goto out;
+			}
+
+		/* a short read is the end of the file */
+		if (a->ca_rv < FSU_CAT_AIOSIZE)
+			break;
+
+		a->ca_done = false;
+		if (fsu_aread(q, fd, a->ca_buf, FSU_CAT_AIOSIZE, roff, a) == -1)
+			goto fail;
+		roff += FSU_CAT_AIOSIZE;
+	}
+	goto out;
+
+fail:
+	warn("%s", filename);
+	rv = -1;
+out:
+	fsu_aioq_destroy(q);
+	free(bufs);
+	return rv;
+}
+
 static void
 usage(void)
 {
@@ -57,44 +57,6 @@
 
 #include "fsu_compat.h"
 
-/* from sys/statvfs.h */
-#define	NB_VFS_NAMELEN	32
-#define	NB_VFS_MNAMELEN	1024
-struct nbstatvfs {
-	unsigned long	f_flag;
-	unsigned long	f_bsize;
-	unsigned long	f_frsize;
-	unsigned long	f_iosize;
-
-	uint64_t	f_blocks;
-
-	uint64_t	f_bfree;
-	uint64_t	f_bavail;
-	uint64_t	f_bresvd;
-
-	uint64_t	f_files;
-	uint64_t	f_ffree;
-	uint64_t	f_favail;
-	uint64_t	f_fresvd;
-
-	uint64_t  	f_syncreads;
-	uint64_t  	f_syncwrites;
-
-	uint64_t  	f_asyncreads;
-	uint64_t  	f_asyncwrites;
-
-	uint32_t	f_notused[2];
-	unsigned long	f_fsid;
-	unsigned long	f_namemax;
-	uint32_t	f_owner;
-
-	uint32_t	f_spare[4];
-
-	char	f_fstypename[NB_VFS_NAMELEN];
-	char	f_mntonname[NB_VFS_MNAMELEN];
-	char	f_mntfromname[NB_VFS_MNAMELEN];
-};
-
 static void	 prtstat(struct nbstatvfs *, int);
 __dead static void usage(void);
 static void	 prthumanval(int64_t, const char *);
@@ -116,8 +78,11 @@ main(int argc, char *argv[])
 	if (fsu_mount(&argc, &argv, MOUNT_READONLY) != 0)
 		usage();
 
-	rump_i_know_what_i_am_doing_with_sysents = 1;
-	rump_pub_lwproc_sysent_usenative();
+	/* the system calls of a session client are served by fsu_sessiond */
+	if (!fsu_session_client()) {
+		rump_i_know_what_i_am_doing_with_sysents = 1;
+		rump_pub_lwproc_sysent_usenative();
+	}
 
 	while ((ch = getopt(argc, argv, "aGghiklmnPt:")) != -1)
 		switch (ch) {
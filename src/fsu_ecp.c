@@ -53,6 +53,7 @@
 #include <fsu_mount.h>
 
 #include "fsu_flist.h"
+#include "fsu_batch.h"
 
 #define FSU_ECP_NO_COPY_LINK (0x01)
 #define FSU_ECP_RECURSIVE (FSU_ECP_NO_COPY_LINK<<1)
@@ -65,6 +66,20 @@
 
 #define BUFSIZE (8192)
 
+/* chunks of a regular file kept in flight while copying it */
+#define FSU_ECP_NAIO (8)
+#define FSU_ECP_AIOSIZE (64 * 1024)
+
+enum { CS_FREE, CS_READING, CS_READ, CS_WRITING };
+
+struct copy_slot {
+	uint8_t *cs_buf;
+	off_t cs_off;
+	ssize_t cs_len;
+	int cs_state;
+};
+
+static int copy_data(const char *, int, const char *, int, int);
 static int copy_dir(const char *, const char *, int);
 static int copy_dir_rec(const char *, char *, int);
 static int copy_fifo(const char *, const char *, int);
@@ -88,16 +103,25 @@ struct hardlink_s {
 	LIST_ENTRY(hardlink_s) next;
 };
 
+#ifndef FSU_BATCH
 int
 main(int argc, char *argv[])
 {
-	size_t len;
-	int cur_arg, flags, rv;
 
 	setprogname(argv[0]);
 	if (fsu_mount(&argc, &argv, MOUNT_READWRITE) != 0)
 		usage();
 
+	return ecp_main(argc, argv);
+}
+#endif
+
+int
+ecp_main(int argc, char *argv[])
+{
+	size_t len;
+	int cur_arg, flags, rv;
+
 	flags = fsu_ecp_parse_arg(&argc, &argv);
 	if (flags == -1 || argc < 2) {
 		usage();
@@ -338,6 +362,8 @@ copy_dir_rec(const char *from_p, char *to_p, int flags)
 
 	if (flags & FSU_ECP_PUT)
 		flist_options |= FSU_FLIST_REALFS;
+	else
+		flist_options |= FSU_FLIST_INOSORT;
 
 	len = strlen(to_p) - 1;
 
@@ -594,12 +620,135 @@ copy_to_file(const char *from, struct stat *frstat,
 	return 0;
 }
 
+/*
+ * Copies the content of fdfrom to fdto, one of them on the host.  The
+ * side in the image is accessed with asynchronous requests at explicit
+ * offsets so that several chunks are in flight, the chunks are written
+ * in order.
+ */
 static int
-copy_file(const char *from, const char *to, int flags)
+copy_data(const char *from, int fdfrom, const char *to, int fdto, int flags)
 {
-	uint8_t buf[BUFSIZE];
+	struct copy_slot *slots, *s;
+	struct fsu_aioev ev;
+	FSU_AIOQ *q;
+	uint8_t *bufs;
 	ssize_t rd, wr;
-	off_t off;
+	off_t roff, woff;
+	bool eof;
+	int i, rv;
+
+	slots = calloc(FSU_ECP_NAIO, sizeof(*slots));
+	bufs = malloc(FSU_ECP_NAIO * FSU_ECP_AIOSIZE);
+	q = fsu_aioq_create();
+	if (slots == NULL || bufs == NULL || q == NULL) {
+		warn(NULL);
+		rv = -1;
+		goto out;
+	}
+	for (i = 0; i < FSU_ECP_NAIO; ++i)
+		slots[i].cs_buf = bufs + i * FSU_ECP_AIOSIZE;
+
+	rv = 0;
+	roff = woff = 0;
+	eof = false;
+	for (;;) {
+		/* fill the free slots */
+		for (i = 0; i < FSU_ECP_NAIO && !eof && rv == 0; ++i) {
+			s = &slots[i];
+			if (s->cs_state != CS_FREE)
+				continue;
+			s->cs_off = roff;
+			if (flags & FSU_ECP_PUT) {
+				rd = read(fdfrom, s->cs_buf, FSU_ECP_AIOSIZE);
+				if (rd == -1) {
+					warn("read %s", from);
+					rv = -1;
+				} else if (rd == 0) {
+					eof = true;
+				} else {
+					s->cs_len = rd;
+					s->cs_state = CS_READ;
+					roff += rd;
+				}
+			} else {
+				if (fsu_aread(q, fdfrom, s->cs_buf,
+					FSU_ECP_AIOSIZE, roff, s) == -1) {
+					warn("read %s", from);
+					rv = -1;
+				} else {
+					s->cs_state = CS_READING;
+					roff += FSU_ECP_AIOSIZE;
+				}
+			}
+		}
+
+		/* write the chunk which comes next, while there is one */
+		for (i = 0; i < FSU_ECP_NAIO && rv == 0; ++i) {
+			s = &slots[i];
+			if (s->cs_state != CS_READ || s->cs_off != woff)
+				continue;
+			if (flags & FSU_ECP_GET) {
+				wr = write(fdto, s->cs_buf, s->cs_len);
+				if (wr != s->cs_len) {
+					warn("write %s", to);
+					rv = -1;
+				}
+				s->cs_state = CS_FREE;
+			} else {
+				if (fsu_awrite(q, fdto, s->cs_buf, s->cs_len,
+					s->cs_off, s) == -1) {
+					warn("write %s", to);
+					rv = -1;
+				}
+				s->cs_state = CS_WRITING;
+			}
+			woff += s->cs_len;
+			i = -1;
+		}
+
+		if (fsu_aioq_pending(q) == 0) {
+			if (eof || rv != 0)
+				break;
+			continue;
+		}
+
+		fsu_aioq_wait(q, &ev, 1, 1);
+		s = ev.ev_cookie;
+		if (s->cs_state == CS_READING) {
+			if (ev.ev_rv == -1) {
+				errno = ev.ev_errno;
+				warn("read %s", from);
+				rv = -1;
+				s->cs_state = CS_FREE;
+				continue;
+			}
+			if (ev.ev_rv < FSU_ECP_AIOSIZE)
+				eof = true;
+			s->cs_len = ev.ev_rv;
+			s->cs_state = ev.ev_rv == 0 ? CS_FREE : CS_READ;
+		} else {
+			if (ev.ev_rv != s->cs_len) {
+				if (ev.ev_rv == -1)
+					errno = ev.ev_errno;
+				warn("write %s", to);
+				rv = -1;
+			}
+			s->cs_state = CS_FREE;
+		}
+	}
+
+out:
+	if (q != NULL)
+		fsu_aioq_destroy(q);
+	free(bufs);
+	free(slots);
+	return rv;
+}
+
+static int
+copy_file(const char *from, const char *to, int flags)
+{
 	int fdfrom, fdto, rv;
 	struct stat from_stat;
 
@@ -637,31 +786,13 @@ copy_file(const char *from, const char *to, int flags)
 		return -1;
 	}
 
-	off = 0;
-	do {
-		if (flags & FSU_ECP_PUT)
-			rd = read(fdfrom, buf, sizeof(buf));
-		else
-			rd = rump_sys_read(fdfrom, buf, sizeof(buf));
-		if (rd == -1) {
-			warn("read %s", from);
-			rv = -1;
-			goto out;
-		}
-		if (flags & FSU_ECP_GET)
-			wr = write(fdto, buf, rd);
-		else
-			wr = rump_sys_write(fdto, buf, rd);
-		if (wr == -1 || wr != rd) {
-			warn("write %s", to);
-			rv = -1;
-			goto out;
-		}
-		off += rd;
-	} while (rd > 0);
-
-	rv = 0;
-out:
+	if (flags & (FSU_ECP_GET | FSU_ECP_PUT))
+		rv = copy_data(from, fdfrom, to, fdto, flags);
+	else if (fsu_copy_range(fdfrom, 0, fdto, 0, from_stat.st_size) == -1) {
+		warn("%s", to);
+		rv = -1;
+	} else
+		rv = 0;
 
 	if (flags & FSU_ECP_GET) {
 		close(fdto);
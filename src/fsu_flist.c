@@ -49,25 +49,38 @@
 #define ISDOT(a) ((a)[0] == '.' && \
 		  ((a)[1] == '\0' || ((a)[1] == '.' && (a)[2] == '\0')))
 
-static FSU_FENT *fsu_flist_alloc(struct dirent *, FSU_FENT *, int);
+/* entries read at once from a directory of the image */
+#define FSU_FLIST_NBATCH (128)
+
+static FSU_FENT *fsu_flist_alloc(const char *, size_t, FSU_FENT *, int);
 static FSU_FENT *fsu_flist_alloc_root(const char *, int);
+static int fsu_flist_inocmp(const void *, const void *);
+static void fsu_flist_inostat(FSU_FENT *, FSU_FENT **, size_t, int);
+static int fsu_flist_stat(FSU_FENT *, int);
 
 static int (*statfun)(const char *, struct stat *);
 
 fsu_flist
 *fsu_flist_build(const char *rootp, int flags)
 {
-	FSU_FENT *cur, *prev, *child;
+	struct fsu_dirent ents[FSU_FLIST_NBATCH];
+	FSU_FENT *cur, *prev, *child, **pend, **tmp;
 	FSU_DIR *curdir;
 	DIR *rcurdir;
 	struct dirent *dent;
 	fsu_flist *head;
+	const char *name;
+	size_t namlen, npend, pendsize;
+	ino_t ino;
+	int i, nent;
 
 	if (rootp == NULL)
 		return NULL;
 
 	curdir = NULL;
 	rcurdir = NULL;
+	pend = NULL;
+	pendsize = 0;
 
 	if (flags & FSU_FLIST_REALFS)
 		statfun = NULL;
@@ -92,28 +105,62 @@ fsu_flist
 		if (flags & FSU_FLIST_REALFS)
 			rcurdir = opendir(cur->path);
 		else
-			curdir = fsu_opendir(cur->path);
+			curdir = fsu_opendir_hint(cur->path,
+			    (size_t)cur->sb.st_size);
 
 		if (curdir == NULL && rcurdir == NULL)
 			continue;
 
 		prev = cur;
-		for (;;) {
-			if (flags & FSU_FLIST_REALFS)
+		npend = 0;
+		for (i = nent = 0;; ++i) {
+			if (flags & FSU_FLIST_REALFS) {
 				dent = readdir(rcurdir);
-			else
-				dent = fsu_readdir(curdir);
-
-			if (dent == NULL)
-				break;
-
-			if (ISDOT(dent->d_name) || dent->d_name[0] == '\0')
+				if (dent == NULL)
+					break;
+				name = dent->d_name;
+				namlen = strlen(name);
+				ino = dent->d_ino;
+			} else {
+				if (i == nent) {
+					nent = fsu_readdir_batch(curdir, ents,
+					    FSU_FLIST_NBATCH);
+					if (nent <= 0)
+						break;
+					i = 0;
+				}
+				name = ents[i].de_name;
+				namlen = ents[i].de_namlen;
+				ino = ents[i].de_ino;
+			}
+
+			if (ISDOT(name) || name[0] == '\0')
 				continue;
 
-			child = fsu_flist_alloc(dent, cur, flags);
+			child = fsu_flist_alloc(name, namlen, cur, flags);
 			if (child == NULL)
 				continue;
 
+			/* Stat'ed once the directory is read, or now. */
+			if (flags & FSU_FLIST_INOSORT) {
+				if (npend == pendsize) {
+					tmp = realloc(pend, (pendsize + 128) *
+					    sizeof(*pend));
+					if (tmp != NULL) {
+						pend = tmp;
+						pendsize += 128;
+					}
+				}
+				if (npend < pendsize) {
+					child->sb.st_ino = ino;
+					pend[npend++] = child;
+				} else if (fsu_flist_stat(child, flags) == -1) {
+					warn("%s", child->path);
+					fsu_flist_free_entry(child);
+					continue;
+				}
+			}
+
 			LIST_INSERT_AFTER(prev, child, next);
 			prev = child;
 
@@ -124,21 +171,69 @@ fsu_flist
 		else
 			fsu_closedir(curdir);
 
+		if (npend > 0)
+			fsu_flist_inostat(cur, pend, npend, flags);
+
 		if (!(flags & FSU_FLIST_RECURSIVE))
 			break;
 	}
+	free(pend);
 
 	return head;
 }
 
+static int
+fsu_flist_inocmp(const void *a, const void *b)
+{
+	const FSU_FENT *fa, *fb;
+
+	fa = *(const FSU_FENT * const *)a;
+	fb = *(const FSU_FENT * const *)b;
+	if (fa->sb.st_ino != fb->sb.st_ino)
+		return fa->sb.st_ino < fb->sb.st_ino ? -1 : 1;
+	return 0;
+}
+
+/*
+ * Stats the entries of a directory in the order of their inode numbers,
+ * as the inodes are laid out in the image, the list keeps its order.
+ * Entries which cannot be stat'ed are removed from it.
+ */
+static void
+fsu_flist_inostat(FSU_FENT *dir, FSU_FENT **pend, size_t npend, int flags)
+{
+	size_t i;
+
+	qsort(pend, npend, sizeof(*pend), fsu_flist_inocmp);
+	for (i = 0; i < npend; ++i) {
+		if (fsu_flist_stat(pend[i], flags) == 0)
+			continue;
+		warn("%s", pend[i]->path);
+		LIST_REMOVE(pend[i], next);
+		fsu_flist_free_entry(pend[i]);
+		dir->childno--;
+	}
+}
+
+static int
+fsu_flist_stat(FSU_FENT *ent, int flags)
+{
+
+	if (flags & FSU_FLIST_REALFS) {
+		if (flags & FSU_FLIST_STATLINK)
+			return lstat(ent->path, &ent->sb);
+		return stat(ent->path, &ent->sb);
+	}
+	return statfun(ent->path, &ent->sb);
+}
+
 static FSU_FENT
-*fsu_flist_alloc(struct dirent *dent, FSU_FENT *parent,
+*fsu_flist_alloc(const char *name, size_t dnamelen, FSU_FENT *parent,
 		 int flags)
 {
 	FSU_FENT *child;
 	int rv;
 	bool is_child_of_slash;
-	size_t dnamelen;
 
 	is_child_of_slash = (parent->path[0] == '/' && parent->path[1] == '\0');
 
@@ -149,11 +244,6 @@ static FSU_FENT
 	}
 
 	child->parent = parent;
-#ifndef HAVE_STRUCT_DIRENT_D_NAMLEN
-	dnamelen = strlen(dent->d_name);
-#else
-	dnamelen = dent->d_namlen;
-#endif
 
 	if (is_child_of_slash)
 		child->pathlen = parent->pathlen + dnamelen;
@@ -167,15 +257,14 @@ static FSU_FENT
 	}
 
 	if (is_child_of_slash)
-		rv = snprintf(child->path, child->pathlen + 1, "/%s",
-			      dent->d_name);
+		rv = snprintf(child->path, child->pathlen + 1, "/%s", name);
 	else
 		rv = snprintf(child->path, child->pathlen + 1, "%s/%s",
-			      parent->path, dent->d_name);
+			      parent->path, name);
 
 	if (rv != (int)child->pathlen) {
 		warn("%s/%s", is_child_of_slash ? "" : parent->path,
-		     dent->d_name);
+		     name);
 		fsu_flist_free_entry(child);
 		return NULL;
 	}
@@ -183,14 +272,11 @@ static FSU_FENT
 	child->filename = child->path + child->pathlen - dnamelen;
 	child->childno = 0;
 
-	if (flags & FSU_FLIST_REALFS) {
-		if (flags & FSU_FLIST_STATLINK)
-			rv = lstat(child->path, &child->sb);
-		else
-			rv = stat(child->path, &child->sb);
-	} else
-		rv = statfun(child->path, &child->sb);
-	if (rv == -1) {
+	/* fsu_flist_build stats it later. */
+	if (flags & FSU_FLIST_INOSORT)
+		return child;
+
+	if (fsu_flist_stat(child, flags) == -1) {
 		warn("%s", child->path);
 		fsu_flist_free_entry(child);
 		return NULL;
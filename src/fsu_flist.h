@@ -33,6 +33,7 @@ struct stat;
 #define FSU_FLIST_RECURSIVE (0x01)
 #define FSU_FLIST_STATLINK (FSU_FLIST_RECURSIVE<<1)
 #define FSU_FLIST_REALFS (FSU_FLIST_STATLINK<<1)
+#define FSU_FLIST_INOSORT (FSU_FLIST_REALFS<<1)
 
 typedef struct fsu_fent_s {
 	struct fsu_fent_s *parent;
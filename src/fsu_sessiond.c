@@ -0,0 +1,167 @@
+/*
+ * Copyright (c) 2026 The fs-utils authors.  All Rights Reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS
+ * OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+#include "fs-utils.h"
+
+#include <sys/file.h>
+#include <sys/stat.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <fsu_mount.h>
+
+#include <rump/rump.h>
+
+/* default idle timeout, in seconds */
+#define IDLE_DEFAULT	300
+
+static void	usage(void);
+static void	quit(int);
+
+static volatile sig_atomic_t done;
+
+/*
+ * Keeps an image mounted and serves the rump system calls of the fsu_*
+ * programs run with FSU_SESSION set to the socket path.  The clients hold
+ * a shared lock on the lock file of the session while they run and touch
+ * it when they start; the server exits when it has been idle for the
+ * timeout, or on SIGHUP, SIGINT or SIGTERM once the clients are done.  It
+ * then holds the lock, removes the socket and the lock file, and the
+ * image is unmounted by fsu_unmount.
+ */
+int
+main(int argc, char *argv[])
+{
+	char url[PATH_MAX + 8], lock[PATH_MAX];
+	struct sigaction sa;
+	struct stat sb;
+	char *path, *ep;
+	time_t last, now;
+	long idle;
+	int ch, fd, rv;
+
+	setprogname(argv[0]);
+
+	/* The session is served here, not attached to. */
+	path = getenv(FSU_SESSION_ENV);
+	if (path != NULL && (path = strdup(path)) == NULL)
+		err(EXIT_FAILURE, NULL);
+	unsetenv(FSU_SESSION_ENV);
+
+	if (fsu_mount(&argc, &argv, MOUNT_READWRITE) != 0)
+		usage();
+
+	idle = IDLE_DEFAULT;
+	while ((ch = getopt(argc, argv, "i:S:")) != -1) {
+		switch (ch) {
+		case 'i':
+			errno = 0;
+			idle = strtol(optarg, &ep, 10);
+			if (errno != 0 || *ep != '\0' || idle < 0)
+				errx(EXIT_FAILURE, "%s: invalid timeout",
+				    optarg);
+			break;
+		case 'S':
+			path = optarg;
+			break;
+		case '?':
+		default:
+			usage();
+			/* NOTREACHED */
+		}
+	}
+	if (path == NULL || *path == '\0' || optind != argc)
+		usage();
+
+	snprintf(url, sizeof(url), "unix://%s", path);
+	if ((size_t)snprintf(lock, sizeof(lock), "%s%s", path,
+	    FSU_SESSION_LOCK) >= sizeof(lock))
+		errx(EXIT_FAILURE, "%s: path too long", path);
+
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = quit;
+	sigemptyset(&sa.sa_mask);
+	(void)sigaction(SIGHUP, &sa, NULL);
+	(void)sigaction(SIGINT, &sa, NULL);
+	(void)sigaction(SIGTERM, &sa, NULL);
+
+	/* The clients find the lock file once the socket is served. */
+	if ((rv = rump_init_server(url)) != 0) {
+		errno = rv;
+		err(EXIT_FAILURE, "%s", path);
+	}
+	if ((fd = open(lock, O_RDWR | O_CREAT | O_TRUNC, 0600)) == -1) {
+		warn("%s", lock);
+		unlink(path);
+		return EXIT_FAILURE;
+	}
+
+	last = time(NULL);
+	while (!done) {
+		(void)sleep(1);
+		now = time(NULL);
+		if (flock(fd, LOCK_EX | LOCK_NB) == -1) {
+			last = now;
+			continue;
+		}
+		if (fstat(fd, &sb) == 0 && sb.st_mtime > last)
+			last = sb.st_mtime;
+		if (idle > 0 && now - last >= idle)
+			break;
+		(void)flock(fd, LOCK_UN);
+	}
+
+	/* Waits for the clients, unless signaled again. */
+	if (done)
+		(void)flock(fd, LOCK_EX);
+	unlink(path);
+	unlink(lock);
+	return EXIT_SUCCESS;
+}
+
+/* ARGSUSED */
+static void
+quit(int sig)
+{
+
+	done = 1;
+}
+
+static void
+usage(void)
+{
+
+	fprintf(stderr, "usage: %s %s [-i idle] [-S socket]\n",
+		getprogname(), fsu_mount_usage());
+
+	exit(EXIT_FAILURE);
+}
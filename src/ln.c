@@ -65,32 +65,33 @@ __RCSID("$NetBSD: ln.c,v 1.3 2009/11/06 11:47:41 stacktic Exp $");
 #include <fsu_utils.h>
 #include <fsu_mount.h>
 
+#include "fsu_batch.h"
+
 
 
 #define stat(a, b) rump_sys_stat(a, b)
 #define lstat(a, b) rump_sys_lstat(a, b)
 #define unlink(a) rump_sys_unlink(a)
 
-int	fflag;				/* Unlink existing files. */
-int	hflag;				/* Check new name for symlink first. */
-int	iflag;				/* Interactive mode. */
-int	sflag;				/* Symbolic, not hard, link. */
-int	vflag;				/* Verbose output */
+static int	fflag;			/* Unlink existing files. */
+static int	hflag;			/* Check new name for symlink first. */
+static int	iflag;			/* Interactive mode. */
+static int	sflag;			/* Symbolic, not hard, link. */
+static int	vflag;			/* Verbose output */
 
 					/* System link call. */
-int (*linkf)(const char *, const char *);
-char   linkch;
+static int (*linkf)(const char *, const char *);
+static char   linkch;
+
+static int	linkit(const char *, const char *, int);
+static void	usage(void);
 
-int	linkit(const char *, const char *, int);
-void	usage(void);
+#ifndef FSU_BATCH
 int	main(int, char *[]);
 
 int
 main(int argc, char *argv[])
 {
-	struct stat sb;
-	int ch, exitval;
-	char *sourcedir;
 
 	setprogname(argv[0]);
 	(void)setlocale(LC_ALL, "");
@@ -98,6 +99,19 @@ main(int argc, char *argv[])
 	if (fsu_mount(&argc, &argv, MOUNT_READWRITE) != 0)
 		errx(-1, NULL);
 
+	exit(ln_main(argc, argv));
+	/* NOTREACHED */
+}
+#endif
+
+int
+ln_main(int argc, char *argv[])
+{
+	struct stat sb;
+	int ch, exitval;
+	char *sourcedir;
+
+	fflag = hflag = iflag = sflag = vflag = 0;
 	while ((ch = getopt(argc, argv, "fhinsv")) != -1)
 		switch (ch) {
 		case 'f':
@@ -140,11 +154,9 @@ main(int argc, char *argv[])
 		usage();
 		/* NOTREACHED */
 	case 1:				/* ln target */
-		exit(linkit(argv[0], ".", 1));
-		/* NOTREACHED */
+		return linkit(argv[0], ".", 1);
 	case 2:				/* ln target source */
-		exit(linkit(argv[0], argv[1], 0));
-		/* NOTREACHED */
+		return linkit(argv[0], argv[1], 0);
 	}
 
 					/* ln target1 target2 directory */
@@ -166,11 +178,10 @@ main(int argc, char *argv[])
 	}
 	for (exitval = 0; *argv != sourcedir; ++argv)
 		exitval |= linkit(*argv, sourcedir, 1);
-	exit(exitval);
-	/* NOTREACHED */
+	return exitval;
 }
 
-int
+static int
 linkit(const char *target, const char *source, int isdir)
 {
 	struct stat sb;
@@ -239,7 +250,7 @@ linkit(const char *target, const char *source, int isdir)
 	return (0);
 }
 
-void
+static void
 usage(void)
 {
 	fprintf(stderr,
@@ -86,16 +86,21 @@ __RCSID("$NetBSD: ls.c,v 1.4 2010/08/23 17:09:59 stacktic Exp $");
 #include <fsu_fts.h>
 #include <fts2fsufts.h>
 
+#include <rump/rump_syscalls.h>
+#include <rump/rumpdefs.h>
+
 #define FTS FSU_FTS
 #define FTSENT FSU_FTSENT
 
 
 static void	 display(FTSENT *, FTSENT *);
 static int	 mastercmp(const FTSENT **, const FTSENT **);
+static void	 streamdir(FTSENT *, int);
 static void	 traverse(int, char **, int);
 
 static void (*printfcn)(DISPLAY *);
 static int (*sortfcn)(const FTSENT *, const FTSENT *);
+static int ftssortkey;		/* sortfcn for fts_setsort() */
 
 #define	BY_NAME 0
 #define	BY_SIZE 1
@@ -129,6 +134,7 @@ int f_singlecol;		/* use single column output */
 int f_size;			/* list size in short listing */
 int f_statustime;		/* use time of last mode change */
 int f_stream;			/* stream format */
+int f_streamdir;		/* print entries as directories are read */
 int f_type;			/* add type character for non-regular files */
 int f_typedir;			/* add type character for directories */
 int f_whiteout;			/* show whiteout entries */
@@ -161,7 +167,7 @@ ls_main(int argc, char *argv[])
 	if (!getuid())
 		f_listdot = 1;
 
-	fts_options = FTS_PHYSICAL;
+	fts_options = FTS_PHYSICAL | FTS_INOSORT;
 	while ((ch = getopt(argc, argv, "1ABCFLRSTWabcdfghiklmnopqrstuwx")) != -1) {
 		switch (ch) {
 		/*
@@ -391,6 +397,34 @@ ls_main(int argc, char *argv[])
 		}
 	}
 
+	/* The same order, on keys, for the entries below the arguments. */
+	switch (sortkey) {
+	case BY_NAME:
+		ftssortkey = FTS_SORT_NAME;
+		break;
+	case BY_SIZE:
+		ftssortkey = FTS_SORT_SIZE;
+		break;
+	case BY_TIME:
+		if (f_accesstime)
+			ftssortkey = FTS_SORT_ATIME;
+		else if (f_statustime)
+			ftssortkey = FTS_SORT_CTIME;
+		else
+			ftssortkey = FTS_SORT_MTIME;
+		break;
+	}
+	if (f_reversesort)
+		ftssortkey |= FTS_SORT_REVERSE;
+
+	/*
+	 * If -f with -1 or -l, print the entries of the directories as they
+	 * are read instead of holding them to size the columns.
+	 */
+	if (f_nosort && (f_singlecol || f_longform) && !f_recursive &&
+	    !f_listdir)
+		f_streamdir = 1;
+
 	/* Select a print function. */
 	if (f_singlecol)
 		printfcn = printscol;
@@ -429,6 +463,8 @@ traverse(int argc, char *argv[], int options)
 	if ((ftsp =
 	    fts_open(argv, options, f_nosort ? NULL : mastercmp)) == NULL)
 		err(EXIT_FAILURE, NULL);
+	if (!f_nosort)
+		(void)fts_setsort(ftsp, ftssortkey);
 
 	display(NULL, fts_children(ftsp, 0));
 	if (f_listdir) {
@@ -469,6 +505,12 @@ traverse(int argc, char *argv[], int options)
 				output = 1;
 			}
 
+			if (f_streamdir) {
+				streamdir(p, options);
+				(void)fts_set(ftsp, p, FTS_SKIP);
+				break;
+			}
+
 			chp = fts_children(ftsp, ch_options);
 			display(p, chp);
 
@@ -483,6 +525,117 @@ traverse(int argc, char *argv[], int options)
 		err(EXIT_FAILURE, "fts_read");
 }
 
+/* entries read at once by streamdir() */
+#define	STREAM_NBATCH	128
+
+/*
+ * Streamdir() prints the entries of the directory p as they are read, for
+ * -f with -1 or -l.  Only one batch of entries is held at a time, and the
+ * fields of the long format have fixed widths instead of being sized on
+ * the whole directory, so that the first entries come out at once.  A
+ * wider value pushes the following fields to the right.
+ */
+static void
+streamdir(FTSENT *p, int options)
+{
+	struct fsu_dirent de[STREAM_NBATCH];
+	struct stat sb;
+	DISPLAY d;
+	FSU_DIR *dirp;
+	FTSENT *cur;
+	NAMES np;
+	const char *name, *user, *group;
+	char nuser[12], ngroup[12];
+	int i, n, needstats;
+
+	if ((dirp = fsu_opendir(p->fts_accpath)) == NULL) {
+		warnx("%s: %s", p->fts_name, strerror(errno));
+		rval = EXIT_FAILURE;
+		return;
+	}
+	if ((cur = malloc(sizeof(FTSENT) + MAXNAMLEN)) == NULL)
+		err(EXIT_FAILURE, NULL);
+	memset(cur, 0, sizeof(FTSENT));
+	cur->fts_parent = p;
+	cur->fts_level = p->fts_level + 1;
+	cur->fts_statp = &sb;
+	cur->fts_pointer = &np;
+	memset(&sb, 0, sizeof(sb));
+
+	memset(&d, 0, sizeof(d));
+	d.list = cur;
+	d.entries = 1;
+	d.s_block = f_humanize ? 4 : 5;
+	d.s_inode = 8;
+	d.s_nlink = 3;
+	d.s_user = 8;
+	d.s_group = 8;
+	d.s_flags = 8;
+	d.s_size = f_humanize ? 4 : 10;
+	d.s_minor = 3;
+	d.s_major = d.s_size - d.s_minor - 2;
+
+	needstats = f_inode || f_longform || f_size || f_type || f_typedir;
+	np.flags = NULL;
+
+	while ((n = fsu_readdir_batch(dirp, de, STREAM_NBATCH)) > 0) {
+		for (i = 0; i < n; i++) {
+			name = de[i].de_name;
+			if (de[i].de_type == DT_WHT && !f_whiteout)
+				continue;
+			if (name[0] == '.' && (!f_listdot ||
+			    (!(options & FTS_SEEDOT) && (de[i].de_namlen == 1 ||
+			    (de[i].de_namlen == 2 && name[1] == '.')))))
+				continue;
+			(void)memcpy(cur->fts_name, name, de[i].de_namlen);
+			cur->fts_name[de[i].de_namlen] = '\0';
+			cur->fts_namelen = de[i].de_namlen;
+
+			if (needstats && rump_sys_fstatat(dirp->dd_fd,
+			    cur->fts_name, &sb, options & FTS_LOGICAL ? 0 :
+			    RUMP_AT_SYMLINK_NOFOLLOW) == -1) {
+				warnx("%s: %s", cur->fts_name,
+				    strerror(errno));
+				rval = EXIT_FAILURE;
+				continue;
+			}
+			if (f_longform) {
+				if (f_numericonly ||
+				    (user = user_from_uid(sb.st_uid, 0)) ==
+				    NULL) {
+					(void)snprintf(nuser, sizeof(nuser),
+					    "%u", sb.st_uid);
+					user = nuser;
+				}
+				if (f_numericonly ||
+				    (group = group_from_gid(sb.st_gid, 0)) ==
+				    NULL) {
+					(void)snprintf(ngroup, sizeof(ngroup),
+					    "%u", sb.st_gid);
+					group = ngroup;
+				}
+				np.user = __UNCONST(user);
+				np.group = __UNCONST(group);
+#ifdef HAVE_STRUCT_STAT_ST_FLAGS
+				if (f_flags)
+					np.flags = flags_to_string(
+					    (u_long)sb.st_flags, "-");
+#endif
+			}
+			printentry(&d, cur);
+			output = 1;
+			free(np.flags);
+			np.flags = NULL;
+		}
+	}
+	if (n == -1) {
+		warnx("%s: %s", p->fts_name, strerror(errno));
+		rval = EXIT_FAILURE;
+	}
+	free(cur);
+	fsu_closedir(dirp);
+}
+
 /*
  * Display() takes a linked list of FTSENT structures and passes the list
  * along with any other necessary information to the print function.  P
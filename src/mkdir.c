@@ -67,21 +67,22 @@ __RCSID("$NetBSD: mkdir.c,v 1.2 2009/11/05 14:39:16 stacktic Exp $");
 #include <fsu_utils.h>
 #include <fsu_mount.h>
 
+#include "fsu_batch.h"
+
 #define chmod(a, b) rump_sys_chmod(a, b)
 #define mkdir(a, b) rump_sys_mkdir(a, b)
 
 #define mkpath(a, b, c) fsu_mkpath(a, b, c)
 int	fsu_mkpath(char *, mode_t, mode_t);
 
-void	usage(void);
+static void	usage(void);
+
+#ifndef FSU_BATCH
 int	main(int, char *[]);
 
 int
 main(int argc, char *argv[])
 {
-	int ch, exitval, pflag;
-	void *set;
-	mode_t mode, dir_mode;
 
 	setprogname(argv[0]);
 	(void)setlocale(LC_ALL, "");
@@ -89,6 +90,18 @@ main(int argc, char *argv[])
 	if (fsu_mount(&argc, &argv, MOUNT_READWRITE) != 0)
 		errx(-1, NULL);
 
+	exit(mkdir_main(argc, argv));
+	/* NOTREACHED */
+}
+#endif
+
+int
+mkdir_main(int argc, char *argv[])
+{
+	int ch, exitval, pflag;
+	void *set;
+	mode_t mode, dir_mode;
+
 	/*
 	 * The default file mode is a=rwx (0777) with selected permissions
 	 * removed in accordance with the file mode creation mask.  For
@@ -159,8 +172,7 @@ main(int argc, char *argv[])
 			}
 		}
 	}
-	exit(exitval);
-	/* NOTREACHED */
+	return exitval;
 }
 
 
@@ -220,7 +232,7 @@ fsu_mkpath(char *path, mode_t mode, mode_t dir_mode)
 	return rump_sys_chmod(path, dir_mode);
 }
 
-void
+static void
 usage(void)
 {
 
@@ -84,6 +84,7 @@ extern int termwidth;
 
 static int	printaname(FTSENT *, int, int);
 static void	printlink(FTSENT *);
+static void	printlongent(DISPLAY *, FTSENT *);
 static void	printtime(time_t);
 static void	printtotal(DISPLAY *dp);
 static int	printtype(u_int);
@@ -112,10 +113,7 @@ printscol(DISPLAY *dp)
 void
 printlong(DISPLAY *dp)
 {
-	struct stat *sp;
 	FTSENT *p;
-	NAMES *np;
-	char buf[20], szbuf[5];
 
 	now = time(NULL);
 
@@ -124,67 +122,88 @@ printlong(DISPLAY *dp)
 	for (p = dp->list; p; p = p->fts_link) {
 		if (IS_NOPRINT(p))
 			continue;
-		sp = p->fts_statp;
-		if (f_inode)
-			(void)printf("%*lu ", dp->s_inode,
-			    (unsigned long)sp->st_ino);
-		if (f_size) {
-			if (f_humanize) {
-				if ((humanize_number(szbuf, sizeof(szbuf),
-					sp->st_blocks * S_BLKSIZE,
-			    "", HN_AUTOSCALE,
+		printlongent(dp, p);
+	}
+}
+
+/*
+ * Prints p alone in the single column or long format, with the field
+ * widths of dp.  There is no total line.
+ */
+void
+printentry(DISPLAY *dp, FTSENT *p)
+{
+
+	if (f_longform) {
+		if (now == 0)
+			now = time(NULL);
+		printlongent(dp, p);
+	} else {
+		(void)printaname(p, dp->s_inode, dp->s_block);
+		(void)putchar('\n');
+	}
+}
+
+static void
+printlongent(DISPLAY *dp, FTSENT *p)
+{
+	struct stat *sp;
+	NAMES *np;
+	char buf[20], szbuf[5];
+
+	sp = p->fts_statp;
+	if (f_inode)
+		(void)printf("%*lu ", dp->s_inode, (unsigned long)sp->st_ino);
+	if (f_size) {
+		if (f_humanize) {
+			if ((humanize_number(szbuf, sizeof(szbuf),
+			    sp->st_blocks * S_BLKSIZE, "", HN_AUTOSCALE,
 			    (HN_DECIMAL | HN_B | HN_NOSPACE))) == -1)
 				err(1, "humanize_number");
 			(void)printf("%*s ", dp->s_block, szbuf);
-			} else {
+		} else {
 			(void)printf("%*llu ", dp->s_block,
-					(long long)howmany(sp->st_blocks,
-							   	blocksize));
-			}
+			    (long long)howmany(sp->st_blocks, blocksize));
 		}
-		(void)strmode(sp->st_mode, buf);
-		np = p->fts_pointer;
-		(void)printf("%s %*lu ", buf, dp->s_nlink,
-		    (unsigned long)sp->st_nlink);
-		if (!f_grouponly)
-			(void)printf("%-*s  ", dp->s_user, np->user);
-		(void)printf("%-*s  ", dp->s_group, np->group);
-		if (f_flags)
-			(void)printf("%-*s ", dp->s_flags, np->flags);
-		if (S_ISCHR(sp->st_mode) || S_ISBLK(sp->st_mode))
-			(void)printf("%*lld, %*lld ",
-			    dp->s_major, (long long)major(sp->st_rdev),
-			    dp->s_minor, (long long)minor(sp->st_rdev));
-		else
-			if (f_humanize) {
-				if ((humanize_number(szbuf, sizeof(szbuf),
-				    sp->st_size, "", HN_AUTOSCALE,
-				    (HN_DECIMAL | HN_B | HN_NOSPACE))) == -1)
-					err(1, "humanize_number");
-				(void)printf("%*s ", dp->s_size, szbuf);
-			} else {
-				(void)printf("%*llu ", dp->s_size,
-				    (long long)sp->st_size);
-			}
-		if (f_accesstime)
-			printtime(sp->st_atime);
-		else if (f_statustime)
-			printtime(sp->st_ctime);
-		else
-			printtime(sp->st_mtime);
-		if (f_octal || f_octal_escape)
-			(void)safe_print(p->fts_name);
-		else if (f_nonprint)
-			(void)printescaped(p->fts_name);
-		else
-			(void)printf("%s", p->fts_name);
-
-		if (f_type || (f_typedir && S_ISDIR(sp->st_mode)))
-			(void)printtype(sp->st_mode);
-		if (S_ISLNK(sp->st_mode))
-			printlink(p);
-		(void)putchar('\n');
 	}
+	(void)strmode(sp->st_mode, buf);
+	np = p->fts_pointer;
+	(void)printf("%s %*lu ", buf, dp->s_nlink,
+	    (unsigned long)sp->st_nlink);
+	if (!f_grouponly)
+		(void)printf("%-*s  ", dp->s_user, np->user);
+	(void)printf("%-*s  ", dp->s_group, np->group);
+	if (f_flags)
+		(void)printf("%-*s ", dp->s_flags, np->flags);
+	if (S_ISCHR(sp->st_mode) || S_ISBLK(sp->st_mode))
+		(void)printf("%*lld, %*lld ",
+		    dp->s_major, (long long)major(sp->st_rdev),
+		    dp->s_minor, (long long)minor(sp->st_rdev));
+	else if (f_humanize) {
+		if ((humanize_number(szbuf, sizeof(szbuf), sp->st_size, "",
+		    HN_AUTOSCALE, (HN_DECIMAL | HN_B | HN_NOSPACE))) == -1)
+			err(1, "humanize_number");
+		(void)printf("%*s ", dp->s_size, szbuf);
+	} else
+		(void)printf("%*llu ", dp->s_size, (long long)sp->st_size);
+	if (f_accesstime)
+		printtime(sp->st_atime);
+	else if (f_statustime)
+		printtime(sp->st_ctime);
+	else
+		printtime(sp->st_mtime);
+	if (f_octal || f_octal_escape)
+		(void)safe_print(p->fts_name);
+	else if (f_nonprint)
+		(void)printescaped(p->fts_name);
+	else
+		(void)printf("%s", p->fts_name);
+
+	if (f_type || (f_typedir && S_ISDIR(sp->st_mode)))
+		(void)printtype(sp->st_mode);
+	if (S_ISLNK(sp->st_mode))
+		printlink(p);
+	(void)putchar('\n');
 }
 
 void
@@ -75,6 +75,8 @@ __RCSID("$NetBSD: rm.c,v 1.2 2009/11/05 14:39:16 stacktic Exp $");
 #include <fsu_utils.h>
 #include <fsu_mount.h>
 
+#include "fsu_batch.h"
+
 #define lstat(a, b) rump_sys_lstat(a, b)
 #define rmdir(a) rump_sys_rmdir(a)
 #define unlink(a) rump_sys_unlink(a)
@@ -83,15 +85,14 @@ __RCSID("$NetBSD: rm.c,v 1.2 2009/11/05 14:39:16 stacktic Exp $");
 
 
 
-int dflag, eval, fflag, iflag, Pflag, stdin_ok, vflag, Wflag;
+static int dflag, eval, fflag, iflag, Pflag, stdin_ok, vflag, Wflag;
 
-int	check(char *, char *, struct stat *);
-void	checkdot(char **);
-void	rm_file(char **);
-int	rm_overwrite(char *, struct stat *);
-void	rm_tree(char **);
-void	usage(void);
-int	main(int, char *[]);
+static int	check(char *, char *, struct stat *);
+static void	checkdot(char **);
+static void	rm_file(char **);
+static int	rm_overwrite(char *, struct stat *);
+static void	rm_tree(char **);
+static void	usage(void);
 
 /*
  * For the sake of the `-f' flag, check whether an error number indicates the
@@ -108,10 +109,12 @@ int	main(int, char *[]);
  *	has two specific effects now, ignore non-existent files and force
  * 	file removal.
  */
+#ifndef FSU_BATCH
+int	main(int, char *[]);
+
 int
 main(int argc, char *argv[])
 {
-	int ch, rflag;
 
 	setprogname(argv[0]);
 	(void)setlocale(LC_ALL, "");
@@ -119,6 +122,17 @@ main(int argc, char *argv[])
 	if (fsu_mount(&argc, &argv, MOUNT_READWRITE) != 0)
 		errx(-1, NULL);
 
+	exit(rm_main(argc, argv));
+	/* NOTREACHED */
+}
+#endif
+
+int
+rm_main(int argc, char *argv[])
+{
+	int ch, rflag;
+
+	dflag = eval = fflag = iflag = vflag = Wflag = 0;
 	Pflag = rflag = 0;
 	while ((ch = getopt(argc, argv, "dfiPRrvW")) != -1)
 		switch (ch) {
@@ -170,11 +184,10 @@ main(int argc, char *argv[])
 			rm_file(argv);
 	}
 
-	exit(eval);
-	/* NOTREACHED */
+	return eval;
 }
 
-void
+static void
 rm_tree(char **argv)
 {
 	FTS *fts;
@@ -287,7 +300,7 @@ rm_tree(char **argv)
 	fts_close(fts);
 }
 
-void
+static void
 rm_file(char **argv)
 {
 	struct stat sb;
@@ -397,13 +410,13 @@ rm_file(char **argv)
  * rm_overwrite will return 0 on success.
  */
 
-int
+static int
 rm_overwrite(char *file, struct stat *sbp)
 {
 	return 0;
 }
 
-int
+static int
 check(char *path, char *name, struct stat *sp)
 {
 	int ch, first;
@@ -453,7 +466,7 @@ check(char *path, char *name, struct stat *sp)
  * trailing slashes have been removed, we'll remove them here.
  */
 #define ISDOT(a) ((a)[0] == '.' && (!(a)[1] || ((a)[1] == '.' && !(a)[2])))
-void
+static void
 checkdot(char **argv)
 {
 	char *p, **save, **t;
@@ -484,7 +497,7 @@ checkdot(char **argv)
 	}
 }
 
-void
+static void
 usage(void)
 {
 
@@ -56,23 +56,25 @@ __RCSID("$NetBSD: rmdir.c,v 1.2 2009/11/05 14:39:16 stacktic Exp $");
 #include <string.h>
 #include <unistd.h>
 
-int	rm_path(char *);
-void	usage(void);
+static int	rm_path(char *);
+static void	usage(void);
 
 #include <rump/rump_syscalls.h>
 #include <fsu_utils.h>
 #include <fsu_mount.h>
 
+#include "fsu_batch.h"
+
 
 
 #define rmdir(a) rump_sys_rmdir(a)
 
+#ifndef FSU_BATCH
 int	main(int, char *[]);
 
 int
 main(int argc, char *argv[])
 {
-	int ch, errors, pflag;
 
 	setprogname(argv[0]);
 	(void)setlocale(LC_ALL, "");
@@ -80,6 +82,16 @@ main(int argc, char *argv[])
 	if (fsu_mount(&argc, &argv, MOUNT_READWRITE) != 0)
 		errx(-1, NULL);
 
+	exit(rmdir_main(argc, argv));
+	/* NOTREACHED */
+}
+#endif
+
+int
+rmdir_main(int argc, char *argv[])
+{
+	int ch, errors, pflag;
+
 	pflag = 0;
 	while ((ch = getopt(argc, argv, "p")) != -1)
 		switch(ch) {
@@ -105,11 +117,10 @@ main(int argc, char *argv[])
 			errors |= rm_path(*argv);
 	}
 
-	exit(errors);
-	/* NOTREACHED */
+	return errors;
 }
 
-int
+static int
 rm_path(char *path)
 {
 	char *p;
@@ -129,7 +140,7 @@ rm_path(char *path)
 	return (0);
 }
 
-void
+static void
 usage(void)
 {
 
@@ -107,10 +107,8 @@ set_utimes(const char *file, struct stat *fs)
 int
 copy_file(FTSENT *entp, int dne)
 {
-	static unsigned char buf[MAXBSIZE];
 	struct stat to_stat, *fs;
-	int ch, checkch, rv, rcount, rval, tolnk, wcount, fdin, fdout;
-	off_t off;
+	int ch, checkch, rv, rval, tolnk, fdin, fdout;
 
 	fs = entp->fts_statp;
 	tolnk = ((Rflag && !(Lflag || Hflag)) || Pflag);
@@ -135,44 +133,41 @@ copy_file(FTSENT *entp, int dne)
 		rump_sys_unlink(to.p_path);
 	}
 
-	rv = rump_sys_open(to.p_path, fs->st_mode & ~(S_ISUID | S_ISGID));
+	rv = rump_sys_open(to.p_path, O_WRONLY | O_TRUNC | O_CREAT,
+	    fs->st_mode & ~(S_ISUID | S_ISGID));
 	if (rv == -1 && (fflag || tolnk)) {
 		/*
 		 * attempt to remove existing destination file name and
 		 * create a new file
 		 */
 		rump_sys_unlink(to.p_path);
-		rv = rump_sys_open(to.p_path,
+		rv = rump_sys_open(to.p_path, O_WRONLY | O_TRUNC | O_CREAT,
 				 fs->st_mode & ~(S_ISUID | S_ISGID));
-		if (rv == -1) {
-			warn("%s", to.p_path);
-			return (1);
-		}
+	}
+	if (rv == -1) {
+		warn("%s", to.p_path);
+		return (1);
 	}
 	fdout = rv;
 	fdin = rump_sys_open(entp->fts_path, O_RDONLY);
+	if (fdin == -1) {
+		warn("%s", entp->fts_path);
+		rump_sys_close(fdout);
+		return (1);
+	}
 
 	rval = 0;
 	/*
 	 * There's no reason to do anything other than close the file
 	 * now if it's empty, so let's not bother.
 	 */
-	off = 0;
-	if (fs->st_size > 0) {
-		while ((rcount = rump_sys_read(fdin, buf, MAXBSIZE)) > 0) {
-			wcount = rump_sys_write(fdout, buf, (size_t)rcount);
-			if (rcount != wcount || wcount == -1) {
-				warn("%s", to.p_path);
-				rval = 1;
-				break;
-			}
-			off += rcount;
-		}
-		if (rcount < 0) {
-			warn("%s", entp->fts_path);
-			rval = 1;
-		}
+	if (fs->st_size > 0 &&
+	    fsu_copy_range(fdin, 0, fdout, 0, fs->st_size) == -1) {
+		warn("%s", to.p_path);
+		rval = 1;
 	}
+	rump_sys_close(fdin);
+	rump_sys_close(fdout);
 
 	if (rval == 1)
 		return (1);
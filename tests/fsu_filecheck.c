@@ -0,0 +1,202 @@
+/*
+ * Copyright (c) 2026 The fs-utils authors.  All Rights Reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS
+ * OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+#include "fs-utils.h"
+
+#include <sys/stat.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <rump/rump_syscalls.h>
+
+#include <fsu_utils.h>
+#include <fsu_mount.h>
+
+/*
+ * Checks the buffering of the fsu_f* streams on a file of the image, the
+ * file holding byte i at offset i.  The file is made, and written again
+ * by the write checks, so that the image must be mounted read-write.
+ * Each check prints a line, the exit status tells whether one failed.
+ */
+#define FC_SIZE	100
+
+static int	fc_failed;
+
+static void	fc_check(bool, const char *);
+static void	fc_make(const char *);
+static void	fc_pread(const char *);
+static void	fc_seek(const char *);
+static void	fc_write(const char *, int, size_t, const char *);
+static void	usage(void);
+
+int
+main(int argc, char *argv[])
+{
+	const char *path;
+
+	setprogname(argv[0]);
+
+	if (fsu_mount(&argc, &argv, MOUNT_READWRITE) != 0)
+		usage();
+
+	if (getopt(argc, argv, "") != -1)
+		usage();
+	argc -= optind;
+	argv += optind;
+
+	if (argc > 1)
+		usage();
+	path = argc == 1 ? argv[0] : "filecheck";
+
+	fc_make(path);
+	fc_seek(path);
+	fc_pread(path);
+	fc_write(path, _IONBF, 0, "fwrite unbuffered");
+	fc_write(path, _IOFBF, 16,
+	    "fwrite with a buffer smaller than a block");
+
+	return fc_failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+static void
+fc_check(bool ok, const char *what)
+{
+
+	printf("%-4s %s\n", ok ? "ok" : "FAIL", what);
+	if (!ok)
+		fc_failed = 1;
+}
+
+static void
+fc_make(const char *path)
+{
+	uint8_t buf[FC_SIZE];
+	int fd, i;
+
+	for (i = 0; i < FC_SIZE; i++)
+		buf[i] = i;
+	fd = rump_sys_open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd == -1)
+		err(EXIT_FAILURE, "%s", path);
+	if (rump_sys_write(fd, buf, FC_SIZE) != FC_SIZE)
+		err(EXIT_FAILURE, "%s", path);
+	rump_sys_close(fd);
+}
+
+/* A read reaching EOF keeps the buffer, a seek back into it uses it */
+static void
+fc_seek(const char *path)
+{
+	uint8_t buf[2 * FC_SIZE];
+	FSU_FILE *file;
+
+	if ((file = fsu_fopen(path, "r")) == NULL)
+		err(EXIT_FAILURE, "%s", path);
+
+	fc_check(fsu_fread(buf, 1, 50, file) == 50 && buf[49] == 49,
+	    "fread");
+	fc_check(fsu_fread(buf, 1, sizeof(buf), file) == FC_SIZE - 50 &&
+	    buf[0] == 50, "fread past EOF");
+	fc_check(fsu_fseek(file, 60, SEEK_SET) == 0 &&
+	    fsu_fgetc(file) == 60, "fseek back into the buffer after EOF");
+	fc_check(fsu_fseek(file, 10, SEEK_SET) == 0 &&
+	    fsu_fgetc(file) == 10 && fsu_fgetc(file) == 11,
+	    "fseek back to the start of the buffer");
+	fc_check(fsu_fseek(file, 0, SEEK_END) == 0 && fsu_fgetc(file) == EOF,
+	    "fseek to EOF");
+
+	fsu_fclose(file);
+}
+
+/* Reads at an offset are served from what the stream has buffered */
+static void
+fc_pread(const char *path)
+{
+	uint8_t buf[2 * FC_SIZE];
+	FSU_FILE *file;
+
+	if ((file = fsu_fopen(path, "r")) == NULL)
+		err(EXIT_FAILURE, "%s", path);
+
+	fc_check(fsu_fread(buf, 1, 30, file) == 30 && buf[29] == 29,
+	    "fread");
+	fc_check(fsu_pread(file, buf, 10, 70) == 10 && buf[0] == 70 &&
+	    buf[9] == 79, "pread ahead of the stream");
+	fc_check(fsu_fgetc(file) == 30, "fread after pread");
+	fc_check(fsu_fread(buf, 1, sizeof(buf), file) == FC_SIZE - 31,
+	    "fread past EOF");
+	fc_check(fsu_pread(file, buf, 10, 70) == 10 && buf[0] == 70 &&
+	    buf[9] == 79, "pread after EOF");
+	fc_check(fsu_pread(file, buf, 10, 95) == 5 && buf[0] == 95,
+	    "pread across EOF");
+
+	fsu_fclose(file);
+}
+
+/*
+ * Writes the file through a stream with the given buffering, which may
+ * be smaller than the blocks of the file system, and reads it back.
+ */
+static void
+fc_write(const char *path, int mode, size_t size, const char *what)
+{
+	uint8_t buf[FC_SIZE], rbuf[FC_SIZE + 1];
+	FSU_FILE *file;
+	ssize_t rv;
+	int fd, i;
+
+	for (i = 0; i < FC_SIZE; i++)
+		buf[i] = i;
+	if ((file = fsu_fopen(path, "w")) == NULL)
+		err(EXIT_FAILURE, "%s", path);
+	if (fsu_setvbuf(file, NULL, mode, size) != 0)
+		err(EXIT_FAILURE, "%s: fsu_setvbuf", path);
+	fc_check(fsu_fwrite(buf, 1, FC_SIZE / 2, file) == FC_SIZE / 2 &&
+	    fsu_fwrite(buf + FC_SIZE / 2, 1, FC_SIZE / 2, file) == FC_SIZE / 2 &&
+	    fsu_fflush(file) == 0 && fsu_ferror(file) == 0, what);
+	fsu_fclose(file);
+
+	if ((fd = rump_sys_open(path, O_RDONLY, 0)) == -1)
+		err(EXIT_FAILURE, "%s", path);
+	rv = rump_sys_read(fd, rbuf, sizeof(rbuf));
+	rump_sys_close(fd);
+	fc_check(rv == FC_SIZE && memcmp(buf, rbuf, FC_SIZE) == 0,
+	    "read back what was written");
+}
+
+static void
+usage(void)
+{
+
+	fprintf(stderr, "usage: %s %s [file]\n", getprogname(),
+	    fsu_mount_usage());
+
+	exit(EXIT_FAILURE);
+}